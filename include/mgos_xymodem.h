@@ -33,6 +33,7 @@
 #define MGOS_XYMODEM_NAK 			0x15
 #define MGOS_XYMODEM_CAN  			0x18
 #define MGOS_XYMODEM_CRC16 			0x43
+#define MGOS_XYMODEM_CPMEOF			0x1A
 
 #define MGOS_XYMODEM_ABORT			0x41
 #define MGOS_XYMODEM_ABORT_ALT 		0x61
@@ -41,6 +42,67 @@
 
 #define MGOS_XYMODEM_PACKET_RETRY	5
 
+// Protocol variants compiled into the library. Override these from the app's
+// mos.yml (cdefs) to drop the variants a product does not need, for example
+// YMODEM-1K-CRC only:
+//
+//   MGOS_XYMODEM_ENABLE_XMODEM: 0
+//   MGOS_XYMODEM_ENABLE_CHECKSUM: 0
+//   MGOS_XYMODEM_ENABLE_128: 0
+//
+// When only one block size or one integrity check is left, the send path uses
+// constant frame sizes instead of branching on every packet.
+
+#ifndef MGOS_XYMODEM_ENABLE_XMODEM
+#define MGOS_XYMODEM_ENABLE_XMODEM		1
+#endif
+
+#ifndef MGOS_XYMODEM_ENABLE_YMODEM
+#define MGOS_XYMODEM_ENABLE_YMODEM		1
+#endif
+
+#ifndef MGOS_XYMODEM_ENABLE_CHECKSUM
+#define MGOS_XYMODEM_ENABLE_CHECKSUM	1
+#endif
+
+#ifndef MGOS_XYMODEM_ENABLE_CRC16
+#define MGOS_XYMODEM_ENABLE_CRC16		1
+#endif
+
+#ifndef MGOS_XYMODEM_ENABLE_128
+#define MGOS_XYMODEM_ENABLE_128			1
+#endif
+
+#ifndef MGOS_XYMODEM_ENABLE_1K
+#define MGOS_XYMODEM_ENABLE_1K			1
+#endif
+
+#if !MGOS_XYMODEM_ENABLE_XMODEM && !MGOS_XYMODEM_ENABLE_YMODEM
+#error "mgos_xymodem: at least one of MGOS_XYMODEM_ENABLE_XMODEM or MGOS_XYMODEM_ENABLE_YMODEM must be set"
+#endif
+
+#if !MGOS_XYMODEM_ENABLE_CHECKSUM && !MGOS_XYMODEM_ENABLE_CRC16
+#error "mgos_xymodem: at least one of MGOS_XYMODEM_ENABLE_CHECKSUM or MGOS_XYMODEM_ENABLE_CRC16 must be set"
+#endif
+
+#if !MGOS_XYMODEM_ENABLE_128 && !MGOS_XYMODEM_ENABLE_1K
+#error "mgos_xymodem: at least one of MGOS_XYMODEM_ENABLE_128 or MGOS_XYMODEM_ENABLE_1K must be set"
+#endif
+
+// Block type used for YModem packets, 1K whenever it is available
+#if MGOS_XYMODEM_ENABLE_1K
+#define MGOS_XYMODEM_DEFAULT_TYPE	MGOS_XYMODEM_STX
+#else
+#define MGOS_XYMODEM_DEFAULT_TYPE	MGOS_XYMODEM_SOH
+#endif
+
+// Block type used for XModem packets, classic 128 byte blocks whenever they are available
+#if MGOS_XYMODEM_ENABLE_128
+#define MGOS_XYMODEM_XMODEM_TYPE	MGOS_XYMODEM_SOH
+#else
+#define MGOS_XYMODEM_XMODEM_TYPE	MGOS_XYMODEM_STX
+#endif
+
 enum mgos_xymodem_crc_type {
 	MGOS_XYMODEM_CHECKSUM,
 	MGOS_XYMODEM_CRC_16
@@ -51,7 +113,8 @@ enum mgos_xymodem_events {
 	MGOS_XYMODEM_READ_FILE,
 	MGOS_XYMODEM_FAILED,
 	MGOS_XYMODEM_COMPLETE,
-	MGOS_XYMODEM_FINISH
+	MGOS_XYMODEM_FINISH,
+	MGOS_XYMODEM_OPEN
 };
 
 enum mgos_xymodem_protocol {
@@ -60,15 +123,59 @@ enum mgos_xymodem_protocol {
 	MGOS_XYMODEM_PROTOCOL_UNKNOWN = 3
 };
 
-struct mgos_xymodem_config_t {
-	uint8_t uart_no;
-};
-
 typedef struct mgos_xymodem_event_params_t {
 	int event;
 	void *data;
 } mgos_xymodem_event_params;
 
+// Reasons a session callback is invoked, passed as its first argument
+enum mgos_xymodem_session_events {
+	MGOS_XYMODEM_SESSION_PROGRESS = 0,
+	MGOS_XYMODEM_SESSION_COMPLETE = 1,
+	MGOS_XYMODEM_SESSION_FAILED = 2
+};
+
+// Transfer statistics, ints so they can be read from mJS with s2o()
+typedef struct mgos_xymodem_stats_t {
+	int bytes_sent;
+	int total_bytes;
+	int files_sent;
+	int total_files;
+	int packets_sent;
+	int retries;
+	double elapsed;
+} mgos_xymodem_stats;
+
+typedef void (*mgos_xymodem_session_cb_t)(int, mgos_xymodem_stats *, void *);
+
+// A file to send, read either from a FILE * (owned by the caller) or from
+// a copy of an in-memory buffer (owned by the session)
+typedef struct mgos_xymodem_source_t {
+	FILE *fp;
+	uint8_t *data;
+	size_t size;
+	size_t offset;
+	char *name;
+	struct mgos_xymodem_source_t *next;
+} mgos_xymodem_source;
+
+// One transfer of one (XModem) or more (YModem batch) sources. Once started,
+// the session is freed by the library right after its final callback; if it
+// could not be started it still belongs to the caller.
+typedef struct mgos_xymodem_session_t {
+	uint8_t uart_no;
+	enum mgos_xymodem_protocol protocol;
+	mgos_xymodem_source *sources;
+	mgos_xymodem_stats stats;
+	size_t completed_bytes;
+	double start_time;
+	bool report_progress;
+	bool started;
+	bool cancelled;
+	mgos_xymodem_session_cb_t cb;
+	void *cb_arg;
+} mgos_xymodem_session;
+
 typedef struct mgos_xymodem_packet_t {
 	uint8_t *payload;
 	uint8_t type;
@@ -80,8 +187,15 @@ typedef struct mgos_xymodem_packet_t {
 	bool is_final;
 	enum mgos_xymodem_protocol protocol;
 	enum mgos_xymodem_crc_type crc_type;
+	mgos_xymodem_session *session;
 } mgos_xymodem_packet;
 
+// Only one transfer runs at a time; while active_session is set it owns the UART
+struct mgos_xymodem_config_t {
+	uint8_t uart_no;
+	mgos_xymodem_session *active_session;
+};
+
 
 struct mgos_xymodem_config_t mgos_xymodem_config;
 
@@ -95,17 +209,53 @@ bool mgos_xymodem_transmit_impl(uint8_t, ...);
 #define mgos_xymodem_transmit(...) \
 		mgos_xymodem_transmit_impl( COUNT_ARGUMENTS(__VA_ARGS__), __VA_ARGS__)
 
+#if MGOS_XYMODEM_ENABLE_YMODEM
 bool mgos_xymodem_transmit_ymodem(FILE *, char *);
+#endif
+#if MGOS_XYMODEM_ENABLE_XMODEM
 bool mgos_xymodem_transmit_xmodem(FILE *);
+#endif
+
+mgos_xymodem_session *mgos_xymodem_session_create(int, int, bool, mgos_xymodem_session_cb_t, void *);
+bool mgos_xymodem_session_add_file(mgos_xymodem_session *, FILE *, char *);
+bool mgos_xymodem_session_add_data(mgos_xymodem_session *, char *, int, char *);
+bool mgos_xymodem_session_start(mgos_xymodem_session *);
+void mgos_xymodem_session_cancel(mgos_xymodem_session *);
+void mgos_xymodem_session_free(mgos_xymodem_session *);
+void mgos_xymodem_session_end(mgos_xymodem_session *, bool);
+void mgos_xymodem_session_progress(mgos_xymodem_session *, mgos_xymodem_packet *);
+bool mgos_xymodem_session_next_source(mgos_xymodem_session *);
+size_t mgos_xymodem_session_read(mgos_xymodem_session *, uint8_t *, size_t);
+size_t mgos_xymodem_session_read_block(mgos_xymodem_session *, mgos_xymodem_packet *);
+mgos_xymodem_packet *mgos_xymodem_session_open_packet(mgos_xymodem_session *);
+const void *mgos_xymodem_stats_descr(void);
 
 unsigned int mgos_xymodem_calc_crc(uint8_t *, uint8_t, uint16_t, uint8_t, uint8_t, uint16_t, uint16_t, uint16_t, uint16_t, uint16_t);
 uint8_t mgos_xymodem_crc_reflect(uint8_t, uint8_t);
 uint8_t mgos_xymodem_calc_checksum(uint8_t *, uint16_t);
-#define mgos_xymodem_crc16(data, start, len) mgos_xymodem_calc_crc(data, start, len, false, false, 0x1021, 0x0000, 0x0000, 0x8000, 0xffff);
+size_t mgos_xymodem_build_frame(mgos_xymodem_packet *, uint8_t *);
+#define mgos_xymodem_crc16(data, start, len) mgos_xymodem_calc_crc16((data) + (start), (len))
+
+// CRC-16/XMODEM (poly 0x1021, init 0x0000), computed a byte at a time without
+// a lookup table so it costs no flash and can be inlined into the send path
+static inline uint16_t mgos_xymodem_calc_crc16(const uint8_t *data, uint16_t len)
+{
+	uint16_t crc = 0x0000;
+	uint8_t x;
+
+	while(len--) {
+		x = (uint8_t)(crc >> 8) ^ *data++;
+		x ^= x >> 4;
+		crc = (uint16_t)((crc << 8) ^ ((uint16_t)x << 12) ^ ((uint16_t)x << 5) ^ x);
+	}
+
+	return crc;
+}
 
 void mgos_xymodem_event_trigger_cb(void *);
 void mgos_xymodem_on_send_packet(int, void *, void *);
 void mgos_xymodem_on_finish(int, void *, void *);
+void mgos_xymodem_on_open(int, void *, void *);
 
 void mgos_xymodem_hex_dump(char *, void *, int);
 uint8_t mgos_xymodem_read_byte();
@@ -121,8 +271,43 @@ mgos_xymodem_packet *mgos_xymodem_create_packet(uint8_t);
 
 #define MGOS_XYMODEM_UART_NO (mgos_xymodem_config.uart_no)
 
+#if MGOS_XYMODEM_ENABLE_128 && MGOS_XYMODEM_ENABLE_1K
+#define MGOS_XYMODEM_TYPE_PAYLOAD_SIZE(type) \
+	(((type) == MGOS_XYMODEM_SOH) ? 128 : 1024)
+#elif MGOS_XYMODEM_ENABLE_1K
+#define MGOS_XYMODEM_TYPE_PAYLOAD_SIZE(type) (1024)
+#else
+#define MGOS_XYMODEM_TYPE_PAYLOAD_SIZE(type) (128)
+#endif
+
 #define MGOS_XYMODEM_PAYLOAD_SIZE(packet) \
-	(((packet)->type == MGOS_XYMODEM_SOH) ? 128 : 1024)
+	MGOS_XYMODEM_TYPE_PAYLOAD_SIZE((packet)->type)
+
+#if MGOS_XYMODEM_ENABLE_CHECKSUM && MGOS_XYMODEM_ENABLE_CRC16
+#define MGOS_XYMODEM_USES_CRC16(packet) \
+	((packet)->crc_type == MGOS_XYMODEM_CRC_16)
+#elif MGOS_XYMODEM_ENABLE_CRC16
+#define MGOS_XYMODEM_USES_CRC16(packet) (true)
+#else
+#define MGOS_XYMODEM_USES_CRC16(packet) (false)
+#endif
+
+#if MGOS_XYMODEM_ENABLE_XMODEM && MGOS_XYMODEM_ENABLE_YMODEM
+#define MGOS_XYMODEM_IS_YMODEM(protocol) \
+	((protocol) == MGOS_XYMODEM_PROTOCOL_YMODEM)
+#define MGOS_XYMODEM_IS_XMODEM(protocol) \
+	((protocol) == MGOS_XYMODEM_PROTOCOL_XMODEM)
+#elif MGOS_XYMODEM_ENABLE_YMODEM
+#define MGOS_XYMODEM_IS_YMODEM(protocol) (true)
+#define MGOS_XYMODEM_IS_XMODEM(protocol) (false)
+#else
+#define MGOS_XYMODEM_IS_YMODEM(protocol) (false)
+#define MGOS_XYMODEM_IS_XMODEM(protocol) (true)
+#endif
+
+// Header (type, number, ~number) + payload + 2 byte CRC or 1 byte checksum
+#define MGOS_XYMODEM_FRAME_SIZE(packet) \
+	(MGOS_XYMODEM_PAYLOAD_SIZE(packet) + 3 + (MGOS_XYMODEM_USES_CRC16(packet) ? 2 : 1))
 
 #define MGOS_XYMODEM_TRIGGER_EVENT(e, d) \
 	do { \
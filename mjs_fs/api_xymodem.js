@@ -21,21 +21,142 @@
 */
 
 let XYModem = {
-	
-	_trns_y : ffi('bool mgos_xymodem_transmit_ymodem(void *, char *)'),
+
+	// Protocols, for XYModem.session()
+	XMODEM : 1,
+	YMODEM : 2,
+
+	// Session callback events
+	PROGRESS : 0,
+	COMPLETE : 1,
+	FAILED : 2,
+
 	_suart : ffi('void mgos_xymodem_set_uart(int)'),
-	
+	_screate : ffi('void *mgos_xymodem_session_create(int, int, bool, void (*)(int, void *, userdata), userdata)'),
+	_sfile : ffi('bool mgos_xymodem_session_add_file(void *, void *, char *)'),
+	_sdata : ffi('bool mgos_xymodem_session_add_data(void *, char *, int, char *)'),
+	_sstart : ffi('bool mgos_xymodem_session_start(void *)'),
+	_scancel : ffi('void mgos_xymodem_session_cancel(void *)'),
+	_sfree : ffi('void mgos_xymodem_session_free(void *)'),
+	_sdescr : ffi('void *mgos_xymodem_stats_descr(void)'),
+	_descr : null,
+
 	create : function(uart_no) {
 		let obj = Object.create(XYModem._proto);
+		obj.uart_no = uart_no;
 		XYModem._suart(uart_no);
 		return obj;
 	},
-	
+
+	// Invoked from C with a pointer to the session stats, which are converted
+	// with s2o() rather than fetched field by field through ffi
+	_cb : function(ev, stats, s) {
+		if (XYModem._descr === null) {
+			XYModem._descr = XYModem._sdescr();
+		}
+
+		let st = s2o(stats, XYModem._descr);
+
+		if (ev === XYModem.PROGRESS) {
+			if (s.onProgress) s.onProgress(st);
+			return;
+		}
+
+		// The C session is freed once this callback returns
+		s._s = null;
+		ffi_cb_free(XYModem._cb, s);
+
+		if (s.onDone) s.onDone(ev === XYModem.COMPLETE, st);
+	},
+
 	_proto : {
+		// Goes through the session API, which unlike
+		// mgos_xymodem_transmit_ymodem() exists in XModem only builds too
 		sendYModem : function(file, filename) {
-			return XYModem._trns_y(file, filename);
+			return this.sendBatch([{ src: file, name: filename }]) !== null;
+		},
+
+		// Creates a transfer session. opts is optional and may contain:
+		//   onProgress: function(stats), called after each acknowledged data block
+		//   onDone: function(ok, stats), called once when the transfer ends
+		session : function(protocol, opts) {
+			let s = Object.create(XYModem._sproto);
+			opts = opts || {};
+			s.onProgress = opts.onProgress || null;
+			s.onDone = opts.onDone || null;
+			s._started = false;
+			s._s = XYModem._screate(this.uart_no, protocol, s.onProgress !== null, XYModem._cb, s);
+			if (!s._s) {
+				ffi_cb_free(XYModem._cb, s);
+				return null;
+			}
+			return s;
+		},
+
+		// Sends a file pointer or string (bytes) over XModem, returns the
+		// started session or null
+		sendXModem : function(src, opts) {
+			let s = this.session(XYModem.XMODEM, opts);
+			if (s === null) return null;
+			if (!s.add(src, null) || !s.start()) {
+				s.free();
+				return null;
+			}
+			return s;
+		},
+
+		// Sends [{ src: file pointer or string, name: "..." }, ...] as a single
+		// YModem batch, returns the started session or null
+		sendBatch : function(files, opts) {
+			let s = this.session(XYModem.YMODEM, opts);
+			if (s === null) return null;
+			for (let i = 0; i < files.length; i++) {
+				if (!s.add(files[i].src, files[i].name)) {
+					s.free();
+					return null;
+				}
+			}
+			if (!s.start()) {
+				s.free();
+				return null;
+			}
+			return s;
 		},
-	
 	},
-	
+
+	_sproto : {
+		// Queues a file pointer, or a string whose bytes are copied, to be sent
+		add : function(src, name) {
+			if (!this._s || this._started) return false;
+			if (typeof src === 'string') {
+				return XYModem._sdata(this._s, src, src.length, name);
+			}
+			return XYModem._sfile(this._s, src, name);
+		},
+
+		// Starts the transfer and returns at once; the result, including a
+		// failed handshake, arrives through onDone. Returns false if the
+		// transfer could not be started at all (e.g. another one is running),
+		// in which case the session can be retried later or freed.
+		start : function() {
+			if (!this._s || this._started) return false;
+			this._started = XYModem._sstart(this._s);
+			return this._started;
+		},
+
+		// Aborts the transfer before the next block, onDone(false, stats) follows
+		cancel : function() {
+			if (this._s) XYModem._scancel(this._s);
+		},
+
+		// Releases a session that was never started
+		free : function() {
+			if (this._s && !this._started) {
+				XYModem._sfree(this._s);
+				ffi_cb_free(XYModem._cb, this);
+				this._s = null;
+			}
+		},
+	},
+
 }
\ No newline at end of file
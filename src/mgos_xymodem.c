@@ -28,11 +28,13 @@
 void mgos_xymodem_init()
 {
 	mgos_xymodem_config.uart_no = 0;
+	mgos_xymodem_config.active_session = NULL;
 
 	mgos_event_register_base(MGOS_XYMODEM_EVENT_BASE, "xymodem");
 
 	mgos_event_add_handler(MGOS_XYMODEM_SEND_PACKET, mgos_xymodem_on_send_packet, NULL);
 	mgos_event_add_handler(MGOS_XYMODEM_FINISH, mgos_xymodem_on_finish, NULL);
+	mgos_event_add_handler(MGOS_XYMODEM_OPEN, mgos_xymodem_on_open, NULL);
 	return true;
 }
 
@@ -43,6 +45,11 @@ void mgos_xymodem_set_uart(uint8_t uart_no) {
 		return;
 	}
 
+	if(mgos_xymodem_config.active_session != NULL) {
+		LOG(LL_ERROR, ("Cannot change UART while a transfer is in progress"));
+		return;
+	}
+
 	mgos_xymodem_config.uart_no = uart_no;
 }
 
@@ -54,10 +61,10 @@ mgos_xymodem_packet *mgos_xymodem_create_packet(uint8_t type)
 
 	retval = malloc(sizeof(mgos_xymodem_packet));
 
-	if(type == MGOS_XYMODEM_SOH) {
+	if(MGOS_XYMODEM_ENABLE_128 && (type == MGOS_XYMODEM_SOH)) {
 		retval->payload = malloc(sizeof(uint8_t) * 128);
 		memset(retval->payload, 0x0, sizeof(uint8_t) * 128);
-	} else if(type == MGOS_XYMODEM_STX) {
+	} else if(MGOS_XYMODEM_ENABLE_1K && (type == MGOS_XYMODEM_STX)) {
 		retval->payload = malloc(sizeof(uint8_t) * 1024);
 		memset(retval->payload, 0x0, sizeof(uint8_t) * 1024);
 	} else {
@@ -73,6 +80,9 @@ mgos_xymodem_packet *mgos_xymodem_create_packet(uint8_t type)
 	retval->number = 0;
 	retval->bytes_sent = 0;
 	retval->is_final = false;
+	retval->crc_type = MGOS_XYMODEM_CHECKSUM;
+	retval->protocol = MGOS_XYMODEM_PROTOCOL_UNKNOWN;
+	retval->session = NULL;
 
 	return retval;
 }
@@ -104,7 +114,9 @@ bool mgos_xymodem_transmit_impl(uint8_t param_count, ...)
 {
 	FILE *fp;
 	va_list v;
+#if MGOS_XYMODEM_ENABLE_YMODEM
 	char *filename;
+#endif
 
 	va_start(v, param_count);
 
@@ -114,6 +126,13 @@ bool mgos_xymodem_transmit_impl(uint8_t param_count, ...)
 
 	if(uart_no > 3) {
 		LOG(LL_ERROR, ("Invalid UART Number for File Transfer: %d", uart_no));
+		va_end(v);
+		return false;
+	}
+
+	if(mgos_xymodem_config.active_session != NULL) {
+		LOG(LL_ERROR, ("Cannot start a transfer while another one is in progress"));
+		va_end(v);
 		return false;
 	}
 
@@ -123,6 +142,7 @@ bool mgos_xymodem_transmit_impl(uint8_t param_count, ...)
 	mgos_uart_set_rx_enabled(mgos_xymodem_config.uart_no, true);
 
 	switch(param_count) {
+#if MGOS_XYMODEM_ENABLE_XMODEM
 		case 2:
 
 			LOG(LL_DEBUG, ("Using XModem Protocol"));
@@ -137,6 +157,8 @@ bool mgos_xymodem_transmit_impl(uint8_t param_count, ...)
 			va_end(v);
 
 			return true;
+#endif
+#if MGOS_XYMODEM_ENABLE_YMODEM
 		case 3:
 
 			LOG(LL_DEBUG, ("Using YModem Protocol"));
@@ -152,6 +174,7 @@ bool mgos_xymodem_transmit_impl(uint8_t param_count, ...)
 			va_end(v);
 
 			return true;
+#endif
 	}
 
 	va_end(v);
@@ -161,73 +184,86 @@ bool mgos_xymodem_transmit_impl(uint8_t param_count, ...)
 
 bool mgos_xymodem_determine_crc(mgos_xymodem_packet *packet)
 {
-	uint8_t tByte;
+	uint8_t tByte, tries = 0;
 
 	LOG(LL_INFO, ("Awaiting destination CRC preference.."));
 
-	tByte = mgos_xymodem_read_byte();
-	switch(tByte) {
-		case MGOS_XYMODEM_NAK:
-			LOG(LL_DEBUG, ("Using Checksum for data verification"));
-			packet->crc_type = MGOS_XYMODEM_CHECKSUM;
-			return true;
-		case MGOS_XYMODEM_CRC16:
-			LOG(LL_DEBUG, ("Using CRC16 for data verification"));
-			packet->crc_type = MGOS_XYMODEM_CRC_16;
-			return true;
-	}
+	// Receivers repeat their preference and fall back from CRC16 to checksum,
+	// never the other way, so a 'C' is worth waiting out when CRC16 isn't
+	// compiled in but a NAK without checksum support is final
+
+	do {
+		tByte = mgos_xymodem_read_byte();
+		tries++;
+
+		switch(tByte) {
+			case MGOS_XYMODEM_NAK:
+#if MGOS_XYMODEM_ENABLE_CHECKSUM
+				LOG(LL_DEBUG, ("Using Checksum for data verification"));
+				packet->crc_type = MGOS_XYMODEM_CHECKSUM;
+				return true;
+#else
+				LOG(LL_ERROR, ("Destination requested Checksum, which is not enabled"));
+				return false;
+#endif
+			case MGOS_XYMODEM_CRC16:
+#if MGOS_XYMODEM_ENABLE_CRC16
+				LOG(LL_DEBUG, ("Using CRC16 for data verification"));
+				packet->crc_type = MGOS_XYMODEM_CRC_16;
+				return true;
+#else
+				LOG(LL_DEBUG, ("Destination requested CRC16, which is not enabled"));
+				continue;
+#endif
+		}
+
+		break;
+	} while(tries < MGOS_XYMODEM_PACKET_RETRY);
 
 	LOG(LL_ERROR, ("Could not determine destination CRC preference, received 0x%02x", tByte));
 
 	return false;
 }
 
+#if MGOS_XYMODEM_ENABLE_YMODEM
 bool mgos_xymodem_transmit_ymodem(FILE *fp, char *filename)
 {
-	mgos_xymodem_packet *packet;
-	char str_file_size[64] = "";
+	mgos_xymodem_session *session;
 
-	packet = mgos_xymodem_create_packet(MGOS_XYMODEM_STX);
+	session = mgos_xymodem_session_create(MGOS_XYMODEM_UART_NO, MGOS_XYMODEM_PROTOCOL_YMODEM, false, NULL, NULL);
 
-	if(!mgos_xymodem_determine_crc(packet)) {
-		MGOS_XYMODEM_FREE_PACKET(packet);
-		MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_FAILED, NULL);
+	if(session == NULL) {
 		return false;
 	}
 
-	packet->protocol = MGOS_XYMODEM_PROTOCOL_YMODEM;
-	packet->fp = fp;
-	fseek(packet->fp, 0, SEEK_END);
-
-	packet->file_size = ftell(fp);
-
-	if(packet->file_size <= 0) {
-		LOG(LL_ERROR, ("Invalid File pointer - could not determine file size or empty file"));
-		MGOS_XYMODEM_FREE_PACKET(packet);
+	if(!mgos_xymodem_session_add_file(session, fp, filename) || !mgos_xymodem_session_start(session)) {
+		mgos_xymodem_session_free(session);
 		return false;
 	}
 
-	fseek(packet->fp, 0, SEEK_SET);
-
-	packet->number = 0;
+	return true;
+}
+#endif
 
-	// @todo can we refactor this to us %s\0%zu
-	c_snprintf(str_file_size, sizeof(str_file_size), "%zu", packet->file_size);
+#if MGOS_XYMODEM_ENABLE_XMODEM
+bool mgos_xymodem_transmit_xmodem(FILE *fp)
+{
+	mgos_xymodem_session *session;
 
-	memcpy(packet->payload, filename, strlen(filename));
-	memcpy(packet->payload + (strlen(filename) + 1), &str_file_size, strlen(str_file_size));
+	session = mgos_xymodem_session_create(MGOS_XYMODEM_UART_NO, MGOS_XYMODEM_PROTOCOL_XMODEM, false, NULL, NULL);
 
-	LOG(LL_DEBUG, ("Created header packet (filename: %s, filesize: %zu", filename, packet->file_size));
+	if(session == NULL) {
+		return false;
+	}
 
-	MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_SEND_PACKET, packet);
+	if(!mgos_xymodem_session_add_file(session, fp, NULL) || !mgos_xymodem_session_start(session)) {
+		mgos_xymodem_session_free(session);
+		return false;
+	}
 
 	return true;
 }
-
-bool mgos_xymodem_transmit_xmodem(FILE *fp)
-{
-	return false;
-}
+#endif
 
 void mgos_xymodem_event_trigger_cb(void *event_params)
 {
@@ -241,7 +277,8 @@ void mgos_xymodem_on_finish(int ev, void *packet_data, void *unused)
 	uint8_t eot = MGOS_XYMODEM_EOT;
 	uint8_t tByte, tries = 0;
 	mgos_xymodem_packet *packet = (mgos_xymodem_packet *)packet_data;
-	mgos_xymodem_packet *final_packet = NULL;
+	mgos_xymodem_session *session = packet->session;
+	mgos_xymodem_packet *next_packet = NULL;
 
 	LOG(LL_DEBUG, ("Entering tranmission finish event on packet #%d", packet->number));
 
@@ -252,62 +289,81 @@ void mgos_xymodem_on_finish(int ev, void *packet_data, void *unused)
 		tries++;
 	} while((tByte != MGOS_XYMODEM_ACK) && (tries < 5));
 
+	MGOS_XYMODEM_FREE_PACKET(packet);
+
 	if(tByte != MGOS_XYMODEM_ACK) {
 		LOG(LL_ERROR, ("Failed to receive an ACK of EOT, received 0x%02x instead", tByte));
-		MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_FAILED, NULL);
+		mgos_xymodem_session_end(session, false);
 		return;
 	}
 
-	if(packet->protocol == MGOS_XYMODEM_PROTOCOL_YMODEM) {
+	if(!MGOS_XYMODEM_IS_YMODEM(session->protocol)) {
+		mgos_xymodem_session_next_source(session);
+		mgos_xymodem_session_end(session, true);
+		return;
+	}
 
-		final_packet = mgos_xymodem_create_packet(MGOS_XYMODEM_STX);
-		final_packet->number = 0;
-		final_packet->is_final = true;
+	if(mgos_xymodem_session_next_source(session)) {
 
-		if(!mgos_xymodem_determine_crc(final_packet)) {
-			MGOS_XYMODEM_FREE_PACKET(final_packet);
-			MGOS_XYMODEM_FREE_PACKET(packet);
-			MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_FAILED, NULL);
-			return;
-		}
+		LOG(LL_DEBUG, ("Creating header packet for next file in YModem batch"));
+
+		next_packet = mgos_xymodem_session_open_packet(session);
+
+	} else {
 
 		LOG(LL_DEBUG, ("Creating final YModem packet with null filename to end transmission"));
 
-		MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_SEND_PACKET, final_packet);
+		next_packet = mgos_xymodem_create_packet(MGOS_XYMODEM_DEFAULT_TYPE);
+		next_packet->number = 0;
+		next_packet->is_final = true;
+		next_packet->protocol = session->protocol;
+		next_packet->session = session;
 
-	} else {
-		LOG(LL_INFO, ("Transmission Complete!"));
-		MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_COMPLETE, NULL);
+		if(!mgos_xymodem_determine_crc(next_packet)) {
+			MGOS_XYMODEM_FREE_PACKET(next_packet);
+			next_packet = NULL;
+		}
 	}
 
-	MGOS_XYMODEM_FREE_PACKET(packet);
+	if(next_packet == NULL) {
+		mgos_xymodem_session_end(session, false);
+		return;
+	}
+
+	MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_SEND_PACKET, next_packet);
 }
 
 void mgos_xymodem_on_send_packet(int ev, void *packet_data, void *unused)
 {
 	mgos_xymodem_packet *packet = (mgos_xymodem_packet *)packet_data;
+	mgos_xymodem_session *session = packet->session;
 	mgos_xymodem_packet *next_packet = NULL;
 	uint8_t *uart_packet;
-	uint8_t tByte;
-	uint16_t crc;
+	uint8_t tByte, tries;
+	uint8_t cancel[] = { MGOS_XYMODEM_CAN, MGOS_XYMODEM_CAN, MGOS_XYMODEM_CAN };
 	size_t uart_packet_len, wrote_len, read_len;
 
 	LOG(LL_DEBUG, ("Entered Send Packet Event"));
 
+	if(session->cancelled) {
+		LOG(LL_INFO, ("Transfer cancelled before packet #%d, notifying destination", packet->number));
+		mgos_uart_write(MGOS_XYMODEM_UART_NO, cancel, sizeof(cancel));
+		mgos_uart_flush(MGOS_XYMODEM_UART_NO);
+		MGOS_XYMODEM_FREE_PACKET(packet);
+		mgos_xymodem_session_end(session, false);
+		return;
+	}
+
 	if(packet->retries > MGOS_XYMODEM_PACKET_RETRY) {
 		LOG(LL_ERROR, ("Attempt to send packet #%d failed %d times, aborting", packet->number, MGOS_XYMODEM_PACKET_RETRY));
 		MGOS_XYMODEM_FREE_PACKET(packet);
-		MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_FAILED, NULL);
+		mgos_xymodem_session_end(session, false);
 		return;
 	}
 
-	if(packet->crc_type = MGOS_XYMODEM_CRC16) {
-		uart_packet_len = MGOS_XYMODEM_PAYLOAD_SIZE(packet) + 5;
-	} else if(packet->crc_type = MGOS_XYMODEM_CHECKSUM) {
-		uart_packet_len = MGOS_XYMODEM_PAYLOAD_SIZE(packet) + 4;
-	}
+	uart_packet_len = MGOS_XYMODEM_FRAME_SIZE(packet);
 
-	LOG(LL_DEBUG, ("Setting UART packet size to %zu based on a payload size of %zu and data integrity check", uart_packet_len, MGOS_XYMODEM_PAYLOAD_SIZE(packet)));
+	LOG(LL_DEBUG, ("Setting UART packet size to %zu based on a payload size of %d and data integrity check", uart_packet_len, MGOS_XYMODEM_PAYLOAD_SIZE(packet)));
 
 	uart_packet = malloc(sizeof(uint8_t) * uart_packet_len);
 
@@ -316,27 +372,7 @@ void mgos_xymodem_on_send_packet(int ev, void *packet_data, void *unused)
 		while(mgos_uart_read(MGOS_XYMODEM_UART_NO, &tByte, 1) > 0);
 	}
 
-	memset(uart_packet, 0x0, uart_packet_len);
-
-	uart_packet[0] = packet->type;
-	uart_packet[1] = packet->number;
-	uart_packet[2] = ~packet->number;
-
-	memcpy(uart_packet + (sizeof(uint8_t) * 3), packet->payload, MGOS_XYMODEM_PAYLOAD_SIZE(packet));
-
-	if(packet->crc_type == MGOS_XYMODEM_CRC16) {
-
-		crc = mgos_xymodem_crc16(uart_packet + (sizeof(uint8_t) * 3),
-								0,
-								MGOS_XYMODEM_PAYLOAD_SIZE(packet));
-
-		uart_packet[uart_packet_len - 2] = (uint8_t)(crc >> 8) & 0xFF;
-		uart_packet[uart_packet_len - 1] = (uint8_t)(crc & 0xFF);
-	} else {
-		uart_packet[uart_packet_len - 1] = mgos_xymodem_calc_checksum(uart_packet + (sizeof(uint8_t) * 3),
-												MGOS_XYMODEM_PAYLOAD_SIZE(packet)
-										   );
-	}
+	mgos_xymodem_build_frame(packet, uart_packet);
 
 	mgos_xymodem_hex_dump("UART Packet", uart_packet, uart_packet_len);
 
@@ -349,8 +385,9 @@ void mgos_xymodem_on_send_packet(int ev, void *packet_data, void *unused)
 	free(uart_packet);
 
 	if(wrote_len != uart_packet_len) {
-		LOG(LL_ERROR, ("Error writing packet to UART, wrote %d byte(s) instead of %d byte(s)", wrote_len, uart_packet_len));
-		MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_FAILED, NULL);
+		LOG(LL_ERROR, ("Error writing packet to UART, wrote %zu byte(s) instead of %zu byte(s)", wrote_len, uart_packet_len));
+		MGOS_XYMODEM_FREE_PACKET(packet);
+		mgos_xymodem_session_end(session, false);
 		return;
 	}
 
@@ -361,14 +398,51 @@ void mgos_xymodem_on_send_packet(int ev, void *packet_data, void *unused)
 
 			LOG(LL_DEBUG, ("Received ACK of packet #%d", packet->number));
 
+			mgos_xymodem_session_progress(session, packet);
+
 			if(packet->is_final) {
 				LOG(LL_DEBUG, ("Packet was marked as final packet, we're done!"));
 				MGOS_XYMODEM_FREE_PACKET(packet);
-				MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_COMPLETE, NULL);
+				mgos_xymodem_session_end(session, true);
 				return;
 			}
 
-			if(feof(packet->fp)) {
+			// After ACKing a YModem header the receiver asks for the first data block
+			// with another 'C' (or NAK); wait for it so it isn't taken as the reply to
+			// block 1 or thrown away with the UART read buffer. The receiver may also
+			// cancel here, anything else is line noise from before block 1 was sent
+
+			if(MGOS_XYMODEM_IS_YMODEM(packet->protocol) && (packet->bytes_sent == 0)) {
+				tries = 0;
+
+				do {
+					tByte = mgos_xymodem_read_byte();
+					tries++;
+
+					if(tByte == MGOS_XYMODEM_CAN) {
+						LOG(LL_DEBUG, ("Received CAN after header packet, confirming.."));
+						tByte = mgos_xymodem_read_byte();
+
+						if(tByte == MGOS_XYMODEM_CAN) {
+							LOG(LL_INFO, ("Transfer cancelled by destination"));
+							MGOS_XYMODEM_FREE_PACKET(packet);
+							mgos_xymodem_session_end(session, false);
+							return;
+						}
+
+						LOG(LL_DEBUG, ("Confirmation of CAN failed after header packet"));
+					}
+
+					if((tByte != MGOS_XYMODEM_CRC16) && (tByte != MGOS_XYMODEM_NAK) && (tByte != 0x0)) {
+						LOG(LL_DEBUG, ("Expected receiver to request first data block, received 0x%02x", tByte));
+					}
+				} while((tByte != MGOS_XYMODEM_CRC16) && (tByte != MGOS_XYMODEM_NAK) && (tByte != 0x0) && (tries < MGOS_XYMODEM_PACKET_RETRY));
+			}
+
+			// bytes_sent counts the file data carried up to and including this packet,
+			// so a YModem header packet (which carries none) never ends the transfer
+
+			if(packet->bytes_sent >= packet->file_size) {
 				LOG(LL_DEBUG, ("Packet file reference is now empty, wrapping up"));
 				MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_FINISH, packet);
 				return;
@@ -377,24 +451,27 @@ void mgos_xymodem_on_send_packet(int ev, void *packet_data, void *unused)
 			LOG(LL_DEBUG, ("Creating next packet"));
 
 			next_packet = mgos_xymodem_create_packet(packet->type);
-			next_packet->bytes_sent = packet->bytes_sent + MGOS_XYMODEM_PAYLOAD_SIZE(packet);
+			next_packet->bytes_sent = packet->bytes_sent;
 			next_packet->number = packet->number + 1;
 			next_packet->fp = packet->fp;
 			next_packet->type = packet->type;
 			next_packet->file_size = packet->file_size;
 			next_packet->protocol = packet->protocol;
 			next_packet->crc_type = packet->crc_type;
+			next_packet->session = session;
 
-			read_len = fread(next_packet->payload, MGOS_XYMODEM_PAYLOAD_SIZE(packet), 1, next_packet->fp);
+			read_len = mgos_xymodem_session_read_block(session, next_packet);
 
-			// Technically this is inaccurate, because whatever is < the payload size
-			// hasn't actually been "sent" yet, but for all intents and purposes
-			// it shouldn't be a problem to be off at the very end by < 1024 bytes
-
-			if(read_len != MGOS_XYMODEM_PAYLOAD_SIZE(next_packet)) {
-				next_packet->bytes_sent += read_len;
+			if(read_len == 0) {
+				LOG(LL_ERROR, ("Failed to read packet #%d from file (%zu of %zu byte(s) sent)", next_packet->number, packet->bytes_sent, packet->file_size));
+				MGOS_XYMODEM_FREE_PACKET(next_packet);
+				MGOS_XYMODEM_FREE_PACKET(packet);
+				mgos_xymodem_session_end(session, false);
+				return;
 			}
 
+			next_packet->bytes_sent += read_len;
+
 			MGOS_XYMODEM_FREE_PACKET(packet);
 			MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_SEND_PACKET, next_packet);
 			return;
@@ -404,6 +481,7 @@ void mgos_xymodem_on_send_packet(int ev, void *packet_data, void *unused)
 			LOG(LL_DEBUG, ("Received NAK for Packet #%d, retrying", packet->number));
 
 			packet->retries++;
+			session->stats.retries++;
 			MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_SEND_PACKET, packet);
 			return;
 
@@ -414,18 +492,21 @@ void mgos_xymodem_on_send_packet(int ev, void *packet_data, void *unused)
 
 			if(tByte == MGOS_XYMODEM_CAN) {
 				LOG(LL_INFO, ("Transfer cancelled by destination"));
-				MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_FAILED, NULL);
+				MGOS_XYMODEM_FREE_PACKET(packet);
+				mgos_xymodem_session_end(session, false);
 				return;
 			}
 
 			LOG(LL_DEBUG, ("Confirmation of CAN failed, retrying packet #%d", packet->number));
 			packet->retries++;
+			session->stats.retries++;
 			MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_SEND_PACKET, packet);
 			return;
 
 		default:
 			LOG(LL_DEBUG, ("Unknown response to packet #%d (0x%02x), retrying", packet->number, tByte));
 			packet->retries++;
+			session->stats.retries++;
 			MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_SEND_PACKET, packet);
 			return;
 	}
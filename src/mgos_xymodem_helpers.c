@@ -112,9 +112,9 @@ unsigned int mgos_xymodem_calc_crc(uint8_t *data, uint8_t start, uint16_t length
 	}
 
 	if (reflectOut != 0)
-		crc = (unsigned int)((mgos_xymodem_crc_reflect(crc, 32) ^ xorOut) & mask);
+		crc = (unsigned int)mgos_xymodem_crc_reflect(crc, 32);
 
-	return crc;
+	return (crc ^ xorOut) & mask;
 }
 
 uint8_t mgos_xymodem_crc_reflect(uint8_t data, uint8_t bits)
@@ -136,7 +136,8 @@ uint8_t mgos_xymodem_crc_reflect(uint8_t data, uint8_t bits)
 
 uint8_t mgos_xymodem_calc_checksum(uint8_t *data, uint16_t len)
 {
-	uint8_t iC, i1;
+	uint8_t iC;
+	uint16_t i1;
 
 	iC = 0;
 
@@ -146,3 +147,30 @@ uint8_t mgos_xymodem_calc_checksum(uint8_t *data, uint16_t len)
 
 	return (uint8_t)(iC & 0xFF);
 }
+
+size_t mgos_xymodem_build_frame(mgos_xymodem_packet *packet, uint8_t *frame)
+{
+	uint16_t crc;
+	size_t frame_len = MGOS_XYMODEM_FRAME_SIZE(packet);
+
+	frame[0] = packet->type;
+	frame[1] = packet->number;
+	frame[2] = ~packet->number;
+
+	memcpy(frame + (sizeof(uint8_t) * 3), packet->payload, MGOS_XYMODEM_PAYLOAD_SIZE(packet));
+
+	if(MGOS_XYMODEM_USES_CRC16(packet)) {
+
+		crc = mgos_xymodem_calc_crc16(frame + (sizeof(uint8_t) * 3),
+								MGOS_XYMODEM_PAYLOAD_SIZE(packet));
+
+		frame[frame_len - 2] = (uint8_t)(crc >> 8) & 0xFF;
+		frame[frame_len - 1] = (uint8_t)(crc & 0xFF);
+	} else {
+		frame[frame_len - 1] = mgos_xymodem_calc_checksum(frame + (sizeof(uint8_t) * 3),
+												MGOS_XYMODEM_PAYLOAD_SIZE(packet)
+										   );
+	}
+
+	return frame_len;
+}
@@ -0,0 +1,426 @@
+/*
+  +----------------------------------------------------------------------+
+  | Mongoose XYModem                                                     |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 2018 John Coggeshall                                   |
+  +----------------------------------------------------------------------+
+  | Licensed under the Apache License, Version 2.0 (the "License");      |
+  | you may not use this file except in compliance with the License. You |
+  | may obtain a copy of the License at:                                 |
+  |                                                                      |
+  | http://www.apache.org/licenses/LICENSE-2.0                           |
+  |                                                                      |
+  | Unless required by applicable law or agreed to in writing, software  |
+  | distributed under the License is distributed on an "AS IS" BASIS,    |
+  | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or      |
+  | implied. See the License for the specific language governing         |
+  | permissions and limitations under the License.                       |
+  +----------------------------------------------------------------------+
+  | Authors: John Coggeshall <john@thissmarthouse.com>                   |
+  +----------------------------------------------------------------------+
+*/
+
+#include <stddef.h>
+#include "mgos_xymodem.h"
+
+#ifdef MGOS_HAVE_MJS
+#include "mjs.h"
+
+static const struct mjs_c_struct_member mgos_xymodem_stats_def[] = {
+	{"bytes_sent", offsetof(mgos_xymodem_stats, bytes_sent), MJS_STRUCT_FIELD_TYPE_INT, NULL},
+	{"total_bytes", offsetof(mgos_xymodem_stats, total_bytes), MJS_STRUCT_FIELD_TYPE_INT, NULL},
+	{"files_sent", offsetof(mgos_xymodem_stats, files_sent), MJS_STRUCT_FIELD_TYPE_INT, NULL},
+	{"total_files", offsetof(mgos_xymodem_stats, total_files), MJS_STRUCT_FIELD_TYPE_INT, NULL},
+	{"packets_sent", offsetof(mgos_xymodem_stats, packets_sent), MJS_STRUCT_FIELD_TYPE_INT, NULL},
+	{"retries", offsetof(mgos_xymodem_stats, retries), MJS_STRUCT_FIELD_TYPE_INT, NULL},
+	{"elapsed", offsetof(mgos_xymodem_stats, elapsed), MJS_STRUCT_FIELD_TYPE_DOUBLE, NULL},
+	{NULL, 0, MJS_STRUCT_FIELD_TYPE_INVALID, NULL},
+};
+
+const void *mgos_xymodem_stats_descr(void)
+{
+	return mgos_xymodem_stats_def;
+}
+#endif
+
+mgos_xymodem_session *mgos_xymodem_session_create(int uart_no, int protocol, bool report_progress, mgos_xymodem_session_cb_t cb, void *cb_arg)
+{
+	mgos_xymodem_session *retval;
+
+	if(uart_no < 0 || uart_no > 3) {
+		LOG(LL_ERROR, ("Invalid UART Number for File Transfer: %d", uart_no));
+		return NULL;
+	}
+
+	switch(protocol) {
+		case MGOS_XYMODEM_PROTOCOL_XMODEM:
+			if(!MGOS_XYMODEM_ENABLE_XMODEM) {
+				LOG(LL_ERROR, ("XModem support is not enabled (MGOS_XYMODEM_ENABLE_XMODEM)"));
+				return NULL;
+			}
+			break;
+		case MGOS_XYMODEM_PROTOCOL_YMODEM:
+			if(!MGOS_XYMODEM_ENABLE_YMODEM) {
+				LOG(LL_ERROR, ("YModem support is not enabled (MGOS_XYMODEM_ENABLE_YMODEM)"));
+				return NULL;
+			}
+			break;
+		default:
+			LOG(LL_ERROR, ("Cannot create session for invalid protocol: %d", protocol));
+			return NULL;
+	}
+
+	retval = malloc(sizeof(mgos_xymodem_session));
+	memset(retval, 0x0, sizeof(mgos_xymodem_session));
+
+	retval->uart_no = uart_no;
+	retval->protocol = protocol;
+	retval->report_progress = report_progress;
+	retval->cb = cb;
+	retval->cb_arg = cb_arg;
+
+	return retval;
+}
+
+static bool mgos_xymodem_session_add_source(mgos_xymodem_session *session, mgos_xymodem_source *source)
+{
+	mgos_xymodem_source **tail;
+	char str_file_size[64] = "";
+
+	if(source->size == 0) {
+		LOG(LL_ERROR, ("Invalid source - could not determine file size or empty file"));
+		return false;
+	}
+
+	if(MGOS_XYMODEM_IS_XMODEM(session->protocol)) {
+		if(session->sources != NULL) {
+			LOG(LL_ERROR, ("XModem can only send a single file per session"));
+			return false;
+		}
+	} else {
+		c_snprintf(str_file_size, sizeof(str_file_size), "%zu", source->size);
+
+		// The filename, the size string and both their terminators have to fit in the header payload
+		if(source->name == NULL || (strlen(source->name) + 1 + strlen(str_file_size)) >= (size_t)MGOS_XYMODEM_TYPE_PAYLOAD_SIZE(MGOS_XYMODEM_DEFAULT_TYPE)) {
+			LOG(LL_ERROR, ("Missing filename or filename too long for a YModem header packet"));
+			return false;
+		}
+	}
+
+	for(tail = &session->sources; *tail != NULL; tail = &(*tail)->next);
+	*tail = source;
+
+	session->stats.total_bytes += source->size;
+	session->stats.total_files++;
+
+	return true;
+}
+
+static void mgos_xymodem_source_free(mgos_xymodem_source *source)
+{
+	if(source->data != NULL) free(source->data);
+	if(source->name != NULL) free(source->name);
+	free(source);
+}
+
+bool mgos_xymodem_session_add_file(mgos_xymodem_session *session, FILE *fp, char *filename)
+{
+	mgos_xymodem_source *source;
+	long file_size;
+
+	if(session == NULL || session->started) {
+		LOG(LL_ERROR, ("Cannot add a file to a missing or already started session"));
+		return false;
+	}
+
+	if(fp == NULL) {
+		LOG(LL_ERROR, ("Invalid File pointer"));
+		return false;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	file_size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	if(file_size <= 0) {
+		LOG(LL_ERROR, ("Invalid File pointer - could not determine file size or empty file"));
+		return false;
+	}
+
+	source = malloc(sizeof(mgos_xymodem_source));
+	memset(source, 0x0, sizeof(mgos_xymodem_source));
+
+	source->fp = fp;
+	source->size = (size_t)file_size;
+	source->name = (filename != NULL) ? strdup(filename) : NULL;
+
+	if(!mgos_xymodem_session_add_source(session, source)) {
+		mgos_xymodem_source_free(source);
+		return false;
+	}
+
+	LOG(LL_DEBUG, ("Added file to session (filename: %s, filesize: %zu)", filename ? filename : "", source->size));
+
+	return true;
+}
+
+bool mgos_xymodem_session_add_data(mgos_xymodem_session *session, char *data, int len, char *filename)
+{
+	mgos_xymodem_source *source;
+
+	if(session == NULL || session->started) {
+		LOG(LL_ERROR, ("Cannot add data to a missing or already started session"));
+		return false;
+	}
+
+	if(data == NULL || len <= 0) {
+		LOG(LL_ERROR, ("Invalid or empty data buffer"));
+		return false;
+	}
+
+	source = malloc(sizeof(mgos_xymodem_source));
+	memset(source, 0x0, sizeof(mgos_xymodem_source));
+
+	// Copied because the caller's buffer (e.g. an mJS string) may not outlive the transfer
+	source->data = malloc(sizeof(uint8_t) * len);
+	memcpy(source->data, data, len);
+	source->size = (size_t)len;
+	source->name = (filename != NULL) ? strdup(filename) : NULL;
+
+	if(!mgos_xymodem_session_add_source(session, source)) {
+		mgos_xymodem_source_free(source);
+		return false;
+	}
+
+	LOG(LL_DEBUG, ("Added buffer to session (filename: %s, size: %zu)", filename ? filename : "", source->size));
+
+	return true;
+}
+
+// Returns false, leaving the session with the caller, if it cannot be started
+// at all. Otherwise returns at once; the opening handshake runs from the event
+// loop and every outcome, including a failed handshake, goes to the callback.
+bool mgos_xymodem_session_start(mgos_xymodem_session *session)
+{
+	if(session == NULL) {
+		return false;
+	}
+
+	if(session->started) {
+		LOG(LL_ERROR, ("Session has already been started"));
+		return false;
+	}
+
+	if(mgos_xymodem_config.active_session != NULL) {
+		LOG(LL_ERROR, ("Cannot start a transfer while another one is in progress"));
+		return false;
+	}
+
+	if(session->sources == NULL) {
+		LOG(LL_ERROR, ("Cannot start a session with nothing to send"));
+		return false;
+	}
+
+	LOG(LL_DEBUG, ("Beginning File Transfer of %d file(s), %d byte(s)", session->stats.total_files, session->stats.total_bytes));
+
+	session->started = true;
+	session->start_time = mgos_uptime();
+
+	mgos_xymodem_config.active_session = session;
+	mgos_xymodem_config.uart_no = session->uart_no;
+
+	mgos_uart_set_dispatcher(mgos_xymodem_config.uart_no, NULL, NULL);
+	mgos_uart_set_rx_enabled(mgos_xymodem_config.uart_no, true);
+
+	MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_OPEN, session);
+
+	return true;
+}
+
+void mgos_xymodem_on_open(int ev, void *session_data, void *unused)
+{
+	mgos_xymodem_session *session = (mgos_xymodem_session *)session_data;
+	mgos_xymodem_packet *packet;
+
+	if(session->cancelled) {
+		LOG(LL_INFO, ("Transfer cancelled before it began"));
+		mgos_xymodem_session_end(session, false);
+		return;
+	}
+
+	packet = mgos_xymodem_session_open_packet(session);
+
+	if(packet == NULL) {
+		mgos_xymodem_session_end(session, false);
+		return;
+	}
+
+	MGOS_XYMODEM_TRIGGER_EVENT(MGOS_XYMODEM_SEND_PACKET, packet);
+}
+
+void mgos_xymodem_session_cancel(mgos_xymodem_session *session)
+{
+	if(session == NULL) {
+		return;
+	}
+
+	LOG(LL_INFO, ("Cancelling transfer"));
+	session->cancelled = true;
+}
+
+void mgos_xymodem_session_free(mgos_xymodem_session *session)
+{
+	mgos_xymodem_source *source;
+
+	if(session == NULL) {
+		return;
+	}
+
+	while(session->sources != NULL) {
+		source = session->sources;
+		session->sources = source->next;
+		mgos_xymodem_source_free(source);
+	}
+
+	free(session);
+}
+
+void mgos_xymodem_session_end(mgos_xymodem_session *session, bool success)
+{
+	session->stats.elapsed = mgos_uptime() - session->start_time;
+
+	if(mgos_xymodem_config.active_session == session) {
+		mgos_xymodem_config.active_session = NULL;
+	}
+
+	if(success) {
+		LOG(LL_INFO, ("Transmission Complete!"));
+	}
+
+	if(session->cb != NULL) {
+		session->cb(success ? MGOS_XYMODEM_SESSION_COMPLETE : MGOS_XYMODEM_SESSION_FAILED, &session->stats, session->cb_arg);
+	}
+
+	MGOS_XYMODEM_TRIGGER_EVENT(success ? MGOS_XYMODEM_COMPLETE : MGOS_XYMODEM_FAILED, NULL);
+
+	mgos_xymodem_session_free(session);
+}
+
+void mgos_xymodem_session_progress(mgos_xymodem_session *session, mgos_xymodem_packet *packet)
+{
+	session->stats.packets_sent++;
+
+	// YModem header and end-of-batch packets carry no file data
+	if(packet->bytes_sent == 0) {
+		return;
+	}
+
+	session->stats.bytes_sent = session->completed_bytes + packet->bytes_sent;
+
+	if(session->report_progress && session->cb != NULL) {
+		session->stats.elapsed = mgos_uptime() - session->start_time;
+		session->cb(MGOS_XYMODEM_SESSION_PROGRESS, &session->stats, session->cb_arg);
+	}
+}
+
+bool mgos_xymodem_session_next_source(mgos_xymodem_session *session)
+{
+	mgos_xymodem_source *source = session->sources;
+
+	session->completed_bytes += source->size;
+	session->stats.files_sent++;
+
+	session->sources = source->next;
+	mgos_xymodem_source_free(source);
+
+	return (session->sources != NULL);
+}
+
+size_t mgos_xymodem_session_read(mgos_xymodem_session *session, uint8_t *buf, size_t len)
+{
+	mgos_xymodem_source *source = session->sources;
+
+	if(source->fp != NULL) {
+		return fread(buf, sizeof(uint8_t), len, source->fp);
+	}
+
+	if(len > (source->size - source->offset)) {
+		len = source->size - source->offset;
+	}
+
+	memcpy(buf, source->data + source->offset, len);
+	source->offset += len;
+
+	return len;
+}
+
+// Fills a data packet from the current source. A short last block is padded
+// with CPMEOF like sz does; XModem has no file length, so whatever pads the
+// block ends up in the received file.
+size_t mgos_xymodem_session_read_block(mgos_xymodem_session *session, mgos_xymodem_packet *packet)
+{
+	size_t read_len;
+
+	read_len = mgos_xymodem_session_read(session, packet->payload, MGOS_XYMODEM_PAYLOAD_SIZE(packet));
+
+	if(read_len < (size_t)MGOS_XYMODEM_PAYLOAD_SIZE(packet)) {
+		memset(packet->payload + read_len, MGOS_XYMODEM_CPMEOF, MGOS_XYMODEM_PAYLOAD_SIZE(packet) - read_len);
+	}
+
+	return read_len;
+}
+
+mgos_xymodem_packet *mgos_xymodem_session_open_packet(mgos_xymodem_session *session)
+{
+	mgos_xymodem_packet *packet;
+	mgos_xymodem_source *source = session->sources;
+	char str_file_size[64] = "";
+	size_t read_len;
+
+	packet = mgos_xymodem_create_packet(MGOS_XYMODEM_IS_YMODEM(session->protocol) ? MGOS_XYMODEM_DEFAULT_TYPE : MGOS_XYMODEM_XMODEM_TYPE);
+
+	if(packet == NULL) {
+		return NULL;
+	}
+
+	if(!mgos_xymodem_determine_crc(packet)) {
+		MGOS_XYMODEM_FREE_PACKET(packet);
+		return NULL;
+	}
+
+	packet->protocol = session->protocol;
+	packet->session = session;
+	packet->fp = source->fp;
+	packet->file_size = source->size;
+
+	if(MGOS_XYMODEM_IS_XMODEM(session->protocol)) {
+
+		packet->number = 1;
+
+		read_len = mgos_xymodem_session_read_block(session, packet);
+
+		if(read_len == 0) {
+			LOG(LL_ERROR, ("Failed to read first packet from source"));
+			MGOS_XYMODEM_FREE_PACKET(packet);
+			return NULL;
+		}
+
+		packet->bytes_sent = read_len;
+
+		LOG(LL_DEBUG, ("Created first XModem packet (filesize: %zu)", packet->file_size));
+
+		return packet;
+	}
+
+	packet->number = 0;
+
+	// @todo can we refactor this to us %s\0%zu
+	c_snprintf(str_file_size, sizeof(str_file_size), "%zu", packet->file_size);
+
+	memcpy(packet->payload, source->name, strlen(source->name));
+	memcpy(packet->payload + (strlen(source->name) + 1), &str_file_size, strlen(str_file_size));
+
+	LOG(LL_DEBUG, ("Created header packet (filename: %s, filesize: %zu)", source->name, packet->file_size));
+
+	return packet;
+}
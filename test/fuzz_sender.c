@@ -0,0 +1,183 @@
+/*
+ * Fuzz target for the sender state machine (mgos_xymodem_on_send_packet,
+ * mgos_xymodem_on_finish and the session code). The input picks the protocol
+ * and payload size, the rest is the byte stream the peer sends back through
+ * the fake UART. Every transfer has to end with exactly one session callback
+ * within a bounded number of steps (host.c aborts otherwise), only write
+ * well formed frames (checked with the reference receiver's own CRC16 and
+ * checksum), and not leak or access memory out of bounds under
+ * ASan/LSan.
+ *
+ * This library only contains a sender, so there is no receiver engine to fuzz.
+ *
+ * Built as a libFuzzer target with clang (make fuzz), or with the standalone
+ * driver below (make fuzz-smoke) which replays files given on the command
+ * line, or runs a fixed number of generated inputs when there are none.
+ */
+
+#include "test_common.h"
+
+static void check_frame(const uint8_t *buf, size_t len, void *arg)
+{
+	size_t payload_len;
+	uint16_t crc;
+
+	if(len == 1 && buf[0] == MGOS_XYMODEM_EOT) {
+		return;
+	}
+
+	if(len == 3 && buf[0] == MGOS_XYMODEM_CAN && buf[1] == MGOS_XYMODEM_CAN && buf[2] == MGOS_XYMODEM_CAN) {
+		return;
+	}
+
+	if(len < 3 || (buf[0] != MGOS_XYMODEM_SOH && buf[0] != MGOS_XYMODEM_STX) || (uint8_t)~buf[1] != buf[2]) {
+		fprintf(stderr, "fuzz: malformed write of %zu byte(s)\n", len);
+		abort();
+	}
+
+	payload_len = (buf[0] == MGOS_XYMODEM_SOH) ? 128 : 1024;
+
+	if(len == payload_len + 5) {
+		crc = ref_crc16(buf + 3, payload_len);
+		if(buf[len - 2] != (uint8_t)(crc >> 8) || buf[len - 1] != (uint8_t)(crc & 0xFF)) {
+			fprintf(stderr, "fuzz: bad CRC16 on block %d\n", buf[1]);
+			abort();
+		}
+	} else if(len == payload_len + 4) {
+		if(buf[len - 1] != ref_checksum(buf + 3, payload_len)) {
+			fprintf(stderr, "fuzz: bad checksum on block %d\n", buf[1]);
+			abort();
+		}
+	} else {
+		fprintf(stderr, "fuzz: frame of %zu byte(s) for a %zu byte payload\n", len, payload_len);
+		abort();
+	}
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	static bool initialized = false;
+	static uint8_t payload[256 * 23 + 1];
+	mgos_xymodem_session *session;
+	test_result res;
+	int protocol;
+	size_t payload_len;
+
+	if(size < 2) {
+		return 0;
+	}
+
+	if(!initialized) {
+		mgos_xymodem_init();
+		initialized = true;
+	}
+
+	protocol = (data[0] & 0x01) ? MGOS_XYMODEM_PROTOCOL_YMODEM : MGOS_XYMODEM_PROTOCOL_XMODEM;
+	payload_len = 1 + data[1] * 23;
+	test_fill(payload, payload_len, data[0]);
+
+	memset(&res, 0x0, sizeof(res));
+	host_reset();
+	host_uart_set_tx(check_frame, NULL);
+	host_uart_set_script(data + 2, size - 2);
+
+	session = mgos_xymodem_session_create(0, protocol, true, test_session_cb, &res);
+
+	if(session == NULL) {
+		return 0;
+	}
+
+	mgos_xymodem_session_add_data(session, (char *)payload, payload_len, "fuzz.bin");
+
+	if(protocol == MGOS_XYMODEM_PROTOCOL_YMODEM && (data[0] & 0x02)) {
+		mgos_xymodem_session_add_data(session, (char *)payload, payload_len / 2 + 1, "fuzz2.bin");
+	}
+
+	mgos_xymodem_session_start(session);
+	host_run();
+
+	if(res.done_calls != 1) {
+		fprintf(stderr, "fuzz: transfer ended with %d final callback(s)\n", res.done_calls);
+		abort();
+	}
+
+	return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+
+#include <time.h>
+#include <unistd.h>
+
+// A hang inside a single callback (e.g. an endless loop over a payload)
+// never reaches host.c's step limit, so bound every input in time as well
+#define FUZZ_INPUT_TIMEOUT	10
+
+static uint8_t fuzz_byte(unsigned int *seed)
+{
+	static const uint8_t protocol_bytes[] = {
+		MGOS_XYMODEM_ACK, MGOS_XYMODEM_NAK, MGOS_XYMODEM_CAN,
+		MGOS_XYMODEM_CRC16, MGOS_XYMODEM_EOT, 0x00
+	};
+
+	*seed = *seed * 1103515245 + 12345;
+
+	// Mostly protocol bytes, with ACK the most common so transfers get deep
+	switch((*seed >> 16) % 8) {
+		case 0:
+		case 1:
+		case 2:
+			return MGOS_XYMODEM_ACK;
+		case 3:
+			return (uint8_t)(*seed >> 8);
+		default:
+			return protocol_bytes[(*seed >> 20) % sizeof(protocol_bytes)];
+	}
+}
+
+int main(int argc, char **argv)
+{
+	static uint8_t input[1024];
+	unsigned int seed, runs, i;
+	size_t len, j;
+	FILE *fp;
+
+	if(argc > 1) {
+		for(i = 1; i < (unsigned int)argc; i++) {
+			fp = fopen(argv[i], "rb");
+			if(fp == NULL) {
+				perror(argv[i]);
+				return 1;
+			}
+			len = fread(input, 1, sizeof(input), fp);
+			fclose(fp);
+			alarm(FUZZ_INPUT_TIMEOUT);
+			LLVMFuzzerTestOneInput(input, len);
+		}
+		printf("fuzz_sender: replayed %d input(s)\n", argc - 1);
+		return 0;
+	}
+
+	runs = getenv("FUZZ_RUNS") ? (unsigned int)atoi(getenv("FUZZ_RUNS")) : 20000;
+	seed = getenv("FUZZ_SEED") ? (unsigned int)atoi(getenv("FUZZ_SEED")) : (unsigned int)time(NULL);
+
+	printf("fuzz_sender: %u run(s), seed %u\n", runs, seed);
+
+	for(i = 0; i < runs; i++) {
+		seed = seed * 1103515245 + 12345;
+		len = (seed >> 16) % sizeof(input);
+		for(j = 0; j < len; j++) {
+			input[j] = fuzz_byte(&seed);
+		}
+		// First two bytes pick protocol and size, keep them uniformly random
+		if(len > 0) input[0] = (uint8_t)(seed >> 3);
+		if(len > 1) input[1] = (uint8_t)(seed >> 11) & 0x3F;
+		alarm(FUZZ_INPUT_TIMEOUT);
+		LLVMFuzzerTestOneInput(input, len);
+	}
+
+	printf("fuzz_sender: OK\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,311 @@
+/*
+ * Host implementation of the stubbed Mongoose OS API, see host.h.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mgos.h"
+#include "mgos_event.h"
+#include "host.h"
+
+#define HOST_MAX_TIMERS		256
+#define HOST_MAX_HANDLERS	16
+#define HOST_RX_SIZE		4096
+
+// A transfer is a bounded number of timer callbacks; anything past this is a hang
+#define HOST_MAX_STEPS		1000000UL
+
+int host_log_level = LL_NONE;
+unsigned int host_sleep_divisor = 0;
+
+static struct {
+	timer_callback cb;
+	void *arg;
+} timers[HOST_MAX_TIMERS];
+static size_t timer_head, timer_tail;
+static unsigned long steps;
+static double virtual_time;
+
+static struct {
+	int ev;
+	mgos_event_handler_t cb;
+	void *arg;
+} handlers[HOST_MAX_HANDLERS];
+static size_t handler_count;
+
+static uint8_t rx[HOST_RX_SIZE];
+static size_t rx_head, rx_tail;
+static uint8_t rx_late[HOST_RX_SIZE];
+static size_t rx_late_len;
+static const uint8_t *script;
+static size_t script_len, script_pos;
+static int uart_fd = -1;
+static host_tx_cb_t tx_cb;
+static void *tx_arg;
+
+void host_reset(void)
+{
+	// XYMODEM_LOG=<level> shows the library's log, e.g. 3 for LL_DEBUG
+	if(getenv("XYMODEM_LOG") != NULL) {
+		host_log_level = atoi(getenv("XYMODEM_LOG"));
+	}
+
+	timer_head = timer_tail = 0;
+	steps = 0;
+	rx_head = rx_tail = 0;
+	rx_late_len = 0;
+	script = NULL;
+	script_len = script_pos = 0;
+	uart_fd = -1;
+	tx_cb = NULL;
+	tx_arg = NULL;
+}
+
+void host_run(void)
+{
+	timer_callback cb;
+	void *arg;
+
+	while(timer_head != timer_tail) {
+		if(++steps > HOST_MAX_STEPS) {
+			fprintf(stderr, "host: transfer did not terminate after %lu steps\n", steps);
+			abort();
+		}
+
+		cb = timers[timer_head % HOST_MAX_TIMERS].cb;
+		arg = timers[timer_head % HOST_MAX_TIMERS].arg;
+		timer_head++;
+		cb(arg);
+	}
+}
+
+unsigned long host_steps(void)
+{
+	return steps;
+}
+
+mgos_timer_id mgos_set_timer(int msecs, int flags, timer_callback cb, void *arg)
+{
+	if(timer_tail - timer_head >= HOST_MAX_TIMERS) {
+		fprintf(stderr, "host: timer queue overflow\n");
+		abort();
+	}
+
+	timers[timer_tail % HOST_MAX_TIMERS].cb = cb;
+	timers[timer_tail % HOST_MAX_TIMERS].arg = arg;
+	timer_tail++;
+
+	return timer_tail;
+}
+
+void mgos_msleep(uint32_t msecs)
+{
+	if(host_sleep_divisor > 0) {
+		usleep((useconds_t)msecs * 1000 / host_sleep_divisor);
+	} else {
+		virtual_time += msecs / 1000.0;
+	}
+}
+
+double host_sleep_time(void)
+{
+	return virtual_time;
+}
+
+double mgos_uptime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9 + virtual_time;
+}
+
+bool mgos_event_register_base(int base, const char *name)
+{
+	return true;
+}
+
+bool mgos_event_add_handler(int ev, mgos_event_handler_t cb, void *arg)
+{
+	if(handler_count >= HOST_MAX_HANDLERS) {
+		return false;
+	}
+
+	handlers[handler_count].ev = ev;
+	handlers[handler_count].cb = cb;
+	handlers[handler_count].arg = arg;
+	handler_count++;
+
+	return true;
+}
+
+int mgos_event_trigger(int ev, void *ev_data)
+{
+	size_t i;
+	int count = 0;
+
+	for(i = 0; i < handler_count; i++) {
+		if(handlers[i].ev == ev) {
+			handlers[i].cb(ev, ev_data, handlers[i].arg);
+			count++;
+		}
+	}
+
+	return count;
+}
+
+static void rx_push(const uint8_t *data, size_t len)
+{
+	while(len-- > 0) {
+		if(rx_tail - rx_head >= HOST_RX_SIZE) {
+			fprintf(stderr, "host: UART rx overflow\n");
+			abort();
+		}
+		rx[rx_tail++ % HOST_RX_SIZE] = *data++;
+	}
+}
+
+void host_uart_set_tx(host_tx_cb_t cb, void *arg)
+{
+	tx_cb = cb;
+	tx_arg = arg;
+}
+
+// Bytes that are already waiting in the UART
+void host_uart_feed(const uint8_t *data, size_t len)
+{
+	rx_push(data, len);
+}
+
+// Bytes the peer sends a moment later: invisible to mgos_uart_read_avail(),
+// they arrive when a read finds the UART empty or by the next write at the latest
+void host_uart_feed_late(const uint8_t *data, size_t len)
+{
+	if(rx_late_len + len > sizeof(rx_late)) {
+		fprintf(stderr, "host: UART late rx overflow\n");
+		abort();
+	}
+
+	memcpy(rx_late + rx_late_len, data, len);
+	rx_late_len += len;
+}
+
+// Peer bytes for fuzzing: one is delivered whenever a read finds the UART
+// empty, and every write releases a further 1-4 bytes into the UART
+void host_uart_set_script(const uint8_t *data, size_t len)
+{
+	script = data;
+	script_len = len;
+	script_pos = 0;
+}
+
+void host_uart_attach_fd(int fd)
+{
+	uart_fd = fd;
+}
+
+size_t mgos_uart_read(int uart_no, void *buf, size_t len)
+{
+	uint8_t *out = (uint8_t *)buf;
+	size_t n = 0;
+	ssize_t r;
+	struct pollfd pfd;
+
+	if(uart_fd >= 0) {
+		pfd.fd = uart_fd;
+		pfd.events = POLLIN;
+		if(poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN)) {
+			return 0;
+		}
+		r = read(uart_fd, buf, len);
+		return (r > 0) ? (size_t)r : 0;
+	}
+
+	if(rx_head == rx_tail) {
+		if(rx_late_len > 0) {
+			rx_push(rx_late, rx_late_len);
+			rx_late_len = 0;
+		} else if(script != NULL && script_pos < script_len) {
+			rx_push(script + script_pos++, 1);
+		}
+	}
+
+	while(n < len && rx_head != rx_tail) {
+		out[n++] = rx[rx_head++ % HOST_RX_SIZE];
+	}
+
+	return n;
+}
+
+size_t mgos_uart_write(int uart_no, const void *buf, size_t len)
+{
+	const uint8_t *in = (const uint8_t *)buf;
+	size_t n = 0, release;
+	ssize_t w;
+
+	if(uart_fd >= 0) {
+		while(n < len) {
+			w = write(uart_fd, in + n, len - n);
+			if(w < 0) {
+				if(errno == EINTR || errno == EAGAIN) continue;
+				break;
+			}
+			n += (size_t)w;
+		}
+		return n;
+	}
+
+	if(rx_late_len > 0) {
+		rx_push(rx_late, rx_late_len);
+		rx_late_len = 0;
+	}
+
+	if(tx_cb != NULL) {
+		tx_cb(in, len, tx_arg);
+	}
+
+	if(script != NULL && script_pos < script_len) {
+		release = 1 + (script[script_pos++] & 0x03);
+		if(release > script_len - script_pos) {
+			release = script_len - script_pos;
+		}
+		rx_push(script + script_pos, release);
+		script_pos += release;
+	}
+
+	return len;
+}
+
+size_t mgos_uart_read_avail(int uart_no)
+{
+	int avail = 0;
+
+	if(uart_fd >= 0) {
+		if(ioctl(uart_fd, FIONREAD, &avail) < 0) {
+			return 0;
+		}
+		return (size_t)avail;
+	}
+
+	return rx_tail - rx_head;
+}
+
+void mgos_uart_flush(int uart_no)
+{
+	if(uart_fd >= 0) {
+		tcdrain(uart_fd);
+	}
+}
+
+void mgos_uart_set_dispatcher(int uart_no, mgos_uart_dispatcher_t cb, void *arg)
+{
+}
+
+void mgos_uart_set_rx_enabled(int uart_no, bool enabled)
+{
+}
@@ -0,0 +1,31 @@
+/*
+ * Host test environment for mgos_xymodem: a timer queue, an event registry
+ * and a fake UART that is either driven in-process or attached to a file
+ * descriptor (e.g. a PTY).
+ */
+
+#ifndef MGOS_XYMODEM_TEST_HOST_H
+#define MGOS_XYMODEM_TEST_HOST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Called with every buffer the library writes to the UART
+typedef void (*host_tx_cb_t)(const uint8_t *, size_t, void *);
+
+// Sleep time of mgos_msleep() is divided by this, 0 means don't sleep at all
+// and advance a virtual clock instead (also reflected in mgos_uptime())
+extern unsigned int host_sleep_divisor;
+
+void host_reset(void);
+void host_run(void);
+unsigned long host_steps(void);
+double host_sleep_time(void);
+
+void host_uart_set_tx(host_tx_cb_t, void *);
+void host_uart_feed(const uint8_t *, size_t);
+void host_uart_feed_late(const uint8_t *, size_t);
+void host_uart_set_script(const uint8_t *, size_t);
+void host_uart_attach_fd(int);
+
+#endif
@@ -0,0 +1,231 @@
+/*
+ * Reference X/YModem receiver, see ref_receiver.h.
+ */
+
+#include "mgos_xymodem.h"
+#include "host.h"
+#include "ref_receiver.h"
+
+// Bitwise CRC-16/XMODEM (poly 0x1021, init 0), kept apart from the library's
+uint16_t ref_crc16(const uint8_t *data, size_t len)
+{
+	uint16_t crc = 0x0000;
+	size_t i;
+	int bit;
+
+	for(i = 0; i < len; i++) {
+		crc ^= (uint16_t)data[i] << 8;
+		for(bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+		}
+	}
+
+	return crc;
+}
+
+// Arithmetic sum of the payload modulo 256
+uint8_t ref_checksum(const uint8_t *data, size_t len)
+{
+	uint8_t sum = 0;
+	size_t i;
+
+	for(i = 0; i < len; i++) {
+		sum += data[i];
+	}
+
+	return sum;
+}
+
+static void ref_rx_reply(uint8_t byte)
+{
+	host_uart_feed(&byte, 1);
+}
+
+// Bytes a real receiver sends a moment after its ACK, once the sender listens
+static void ref_rx_reply_late(uint8_t byte)
+{
+	host_uart_feed_late(&byte, 1);
+}
+
+static void ref_rx_fail(ref_rx *r, const char *why)
+{
+	uint8_t cancel[] = { MGOS_XYMODEM_CAN, MGOS_XYMODEM_CAN };
+
+	fprintf(stderr, "ref_rx: %s\n", why);
+	r->error = true;
+	r->done = true;
+	host_uart_feed(cancel, sizeof(cancel));
+}
+
+static void ref_rx_on_tx(const uint8_t *buf, size_t len, void *arg)
+{
+	ref_rx *r = (ref_rx *)arg;
+	ref_rx_file *f;
+	size_t payload_len, take;
+	uint16_t crc;
+	const uint8_t *payload;
+
+	if(r->done) {
+		return;
+	}
+
+	if(len == 1 && buf[0] == MGOS_XYMODEM_EOT) {
+		ref_rx_reply(MGOS_XYMODEM_ACK);
+		if(r->ymodem) {
+			r->want_header = true;
+			ref_rx_reply_late(r->crc ? MGOS_XYMODEM_CRC16 : MGOS_XYMODEM_NAK);
+		} else {
+			r->done = true;
+		}
+		return;
+	}
+
+	if(len >= 2 && buf[0] == MGOS_XYMODEM_CAN && buf[1] == MGOS_XYMODEM_CAN) {
+		r->cancelled = true;
+		r->done = true;
+		return;
+	}
+
+	if(buf[0] != MGOS_XYMODEM_SOH && buf[0] != MGOS_XYMODEM_STX) {
+		ref_rx_fail(r, "unexpected bytes from sender");
+		return;
+	}
+
+	payload_len = (buf[0] == MGOS_XYMODEM_SOH) ? 128 : 1024;
+	payload = buf + 3;
+
+	if(len != payload_len + 3 + (r->crc ? 2 : 1)) {
+		ref_rx_fail(r, "frame length does not match the negotiated integrity check");
+		return;
+	}
+
+	if((uint8_t)~buf[1] != buf[2]) {
+		ref_rx_fail(r, "block number complement mismatch");
+		return;
+	}
+
+	if(r->crc) {
+		crc = ref_crc16(payload, payload_len);
+		if(buf[len - 2] != (uint8_t)(crc >> 8) || buf[len - 1] != (uint8_t)(crc & 0xFF)) {
+			ref_rx_fail(r, "CRC16 mismatch");
+			return;
+		}
+	} else if(buf[len - 1] != ref_checksum(payload, payload_len)) {
+		ref_rx_fail(r, "checksum mismatch");
+		return;
+	}
+
+	r->frames++;
+
+	if(r->nak_block >= 0 && !r->nak_sent && buf[1] == (uint8_t)r->nak_block && !r->want_header) {
+		r->nak_sent = true;
+		ref_rx_reply(MGOS_XYMODEM_NAK);
+		return;
+	}
+
+	if(r->want_header) {
+		if(buf[1] != 0) {
+			ref_rx_fail(r, "expected a YModem header in block 0");
+			return;
+		}
+
+		ref_rx_reply(MGOS_XYMODEM_ACK);
+		r->want_header = false;
+
+		if(payload[0] == 0x00) {
+			r->done = true;
+			return;
+		}
+
+		if(r->file_count >= REF_RX_MAX_FILES) {
+			ref_rx_fail(r, "too many files in batch");
+			return;
+		}
+
+		f = &r->files[r->file_count++];
+		snprintf(f->name, sizeof(f->name), "%s", (const char *)payload);
+		f->size = strtoul((const char *)payload + strlen((const char *)payload) + 1, NULL, 10);
+		f->data = malloc(f->size > 0 ? f->size : 1);
+		f->len = 0;
+
+		r->expected = 1;
+		if(r->after_header != NULL) {
+			host_uart_feed_late(r->after_header, r->after_header_len);
+		} else {
+			ref_rx_reply_late(r->crc ? MGOS_XYMODEM_CRC16 : MGOS_XYMODEM_NAK);
+		}
+		return;
+	}
+
+	if(buf[1] == (uint8_t)(r->expected - 1)) {
+		r->duplicates++;
+		ref_rx_reply(MGOS_XYMODEM_ACK);
+		return;
+	}
+
+	if(buf[1] != r->expected) {
+		ref_rx_fail(r, "out of sequence block");
+		return;
+	}
+
+	if(r->file_count == 0) {
+		f = &r->files[r->file_count++];
+		f->size = 0;
+		f->data = NULL;
+		f->len = 0;
+	}
+
+	f = &r->files[r->file_count - 1];
+
+	if(r->ymodem) {
+		take = (f->size - f->len < payload_len) ? f->size - f->len : payload_len;
+	} else {
+		take = payload_len;
+		f->data = realloc(f->data, f->len + take);
+		f->size = f->len + take;
+	}
+
+	memcpy(f->data + f->len, payload, take);
+	f->len += take;
+	r->expected++;
+
+	ref_rx_reply(MGOS_XYMODEM_ACK);
+}
+
+void ref_rx_start(ref_rx *r, bool ymodem, bool crc)
+{
+	int nak_block = r->nak_block;
+	const uint8_t *greeting = r->greeting;
+	size_t greeting_len = r->greeting_len;
+	const uint8_t *after_header = r->after_header;
+	size_t after_header_len = r->after_header_len;
+
+	memset(r, 0x0, sizeof(ref_rx));
+	r->ymodem = ymodem;
+	r->crc = crc;
+	r->nak_block = nak_block;
+	r->greeting = greeting;
+	r->greeting_len = greeting_len;
+	r->after_header = after_header;
+	r->after_header_len = after_header_len;
+	r->want_header = ymodem;
+	r->expected = 1;
+
+	host_uart_set_tx(ref_rx_on_tx, r);
+
+	if(greeting != NULL) {
+		host_uart_feed(greeting, greeting_len);
+	} else {
+		ref_rx_reply(crc ? MGOS_XYMODEM_CRC16 : MGOS_XYMODEM_NAK);
+	}
+}
+
+void ref_rx_free(ref_rx *r)
+{
+	int i;
+
+	for(i = 0; i < r->file_count; i++) {
+		free(r->files[i].data);
+		r->files[i].data = NULL;
+	}
+}
@@ -0,0 +1,54 @@
+/*
+ * Reference X/YModem receiver used as the peer of the sender in the host
+ * tests. It is attached to the fake UART and answers every frame written.
+ */
+
+#ifndef MGOS_XYMODEM_TEST_REF_RECEIVER_H
+#define MGOS_XYMODEM_TEST_REF_RECEIVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define REF_RX_MAX_FILES	4
+
+typedef struct ref_rx_file_t {
+	char name[128];
+	size_t size;
+	uint8_t *data;
+	size_t len;
+} ref_rx_file;
+
+typedef struct ref_rx_t {
+	// Configuration
+	bool ymodem;
+	bool crc;
+	int nak_block;		// NAK the first copy of this block number, -1 for none
+	const uint8_t *greeting;	// Opening request bytes, NULL for a single 'C'/NAK
+	size_t greeting_len;
+	const uint8_t *after_header;	// Sent instead of the 'C'/NAK that follows a header ACK, NULL for that
+	size_t after_header_len;
+
+	// Results
+	ref_rx_file files[REF_RX_MAX_FILES];
+	int file_count;
+	int frames;
+	int duplicates;
+	bool done;
+	bool cancelled;
+	bool error;
+
+	// State
+	bool want_header;
+	uint8_t expected;
+	bool nak_sent;
+} ref_rx;
+
+// Integrity checks independent of the library's mgos_xymodem_calc_*()
+uint16_t ref_crc16(const uint8_t *, size_t);
+uint8_t ref_checksum(const uint8_t *, size_t);
+
+void ref_rx_start(ref_rx *, bool, bool);
+void ref_rx_free(ref_rx *);
+
+#endif
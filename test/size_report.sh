@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# Per-function code size of the library in the full configuration and in two
+# reduced ones (MGOS_XYMODEM_ENABLE_*), compiled with -Os -ffunction-sections.
+#
+# These are numbers for the host compiler (CC, default cc) against the stub
+# headers, not ESP8266/ESP32 numbers; run it with CC=xtensa-lx106-elf-gcc (plus
+# the Mongoose OS include paths in place of stubs/) for those. Functions that
+# nothing in a configuration calls, such as the generic mgos_xymodem_calc_crc()
+# which the send path no longer uses, are only dropped by --gc-sections at link
+# time; they are listed but left out of the "used" total.
+
+cd "$(dirname "$0")" || exit 1
+
+CC=${CC:-cc}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+UNUSED="mgos_xymodem_calc_crc mgos_xymodem_crc_reflect"
+
+report() {
+	name=$1
+	shift
+
+	for src in ../src/*.c; do
+		$CC -std=gnu99 -Os -ffunction-sections -fcommon -w -Istubs -I../include "$@" \
+			-c "$src" -o "$TMP/$(basename "$src" .c).o" || exit 1
+	done
+
+	echo "== $name ($*)"
+	size -A "$TMP"/*.o | awk -v unused="$UNUSED" '
+		BEGIN { n = split(unused, u, " "); for(i = 1; i <= n; i++) skip[u[i]] = 1 }
+		$1 ~ /^\.text\./ {
+			fn = substr($1, 7)
+			note = (fn in skip) ? "  (unused, dropped by --gc-sections)" : ""
+			printf "  %-40s %6d%s\n", fn, $2, note
+			if(!(fn in skip)) used += $2
+			all += $2
+		}
+		END { printf "  %-40s %6d\n  %-40s %6d\n", "total used", used, "total incl. unused", all }'
+}
+
+report "full"
+report "YMODEM-1K-CRC only" -DMGOS_XYMODEM_ENABLE_XMODEM=0 -DMGOS_XYMODEM_ENABLE_CHECKSUM=0 -DMGOS_XYMODEM_ENABLE_128=0
+report "XMODEM-128-checksum only" -DMGOS_XYMODEM_ENABLE_YMODEM=0 -DMGOS_XYMODEM_ENABLE_CRC16=0 -DMGOS_XYMODEM_ENABLE_1K=0
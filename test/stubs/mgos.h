@@ -0,0 +1,55 @@
+/*
+ * Minimal host stand-in for the parts of the Mongoose OS API used by
+ * mgos_xymodem. Implemented in test/host.c; only for the host test build.
+ */
+
+#ifndef MGOS_XYMODEM_TEST_STUB_MGOS_H
+#define MGOS_XYMODEM_TEST_STUB_MGOS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+enum cs_log_level {
+	LL_NONE = -1,
+	LL_ERROR = 0,
+	LL_WARN = 1,
+	LL_INFO = 2,
+	LL_DEBUG = 3,
+	LL_VERBOSE_DEBUG = 4
+};
+
+extern int host_log_level;
+
+#define LOG(l, x) \
+	do { \
+		if((l) <= host_log_level) { \
+			printf x; \
+			printf("\n"); \
+		} \
+	} while(0)
+
+#define c_snprintf snprintf
+
+typedef uintptr_t mgos_timer_id;
+typedef void (*timer_callback)(void *);
+
+#define MGOS_TIMER_REPEAT	1
+#define MGOS_TIMER_RUN_NOW	2
+
+mgos_timer_id mgos_set_timer(int, int, timer_callback, void *);
+void mgos_msleep(uint32_t);
+double mgos_uptime(void);
+
+typedef void (*mgos_uart_dispatcher_t)(int, void *);
+
+size_t mgos_uart_read(int, void *, size_t);
+size_t mgos_uart_write(int, const void *, size_t);
+size_t mgos_uart_read_avail(int);
+void mgos_uart_flush(int);
+void mgos_uart_set_dispatcher(int, mgos_uart_dispatcher_t, void *);
+void mgos_uart_set_rx_enabled(int, bool);
+
+#endif
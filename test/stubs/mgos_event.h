@@ -0,0 +1,18 @@
+/*
+ * Minimal host stand-in for mgos_event.h, implemented in test/host.c.
+ */
+
+#ifndef MGOS_XYMODEM_TEST_STUB_MGOS_EVENT_H
+#define MGOS_XYMODEM_TEST_STUB_MGOS_EVENT_H
+
+#include <stdbool.h>
+
+#define MGOS_EVENT_BASE(a, b, c) ((a) << 24 | (b) << 16 | (c) << 8)
+
+typedef void (*mgos_event_handler_t)(int, void *, void *);
+
+bool mgos_event_register_base(int, const char *);
+bool mgos_event_add_handler(int, mgos_event_handler_t, void *);
+int mgos_event_trigger(int, void *);
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ * Shared helpers for the host tests, see test_common.h.
+ */
+
+#include "test_common.h"
+
+int test_failures = 0;
+
+void test_session_cb(int ev, mgos_xymodem_stats *stats, void *arg)
+{
+	test_result *res = (test_result *)arg;
+
+	res->last_event = ev;
+	res->stats = *stats;
+
+	if(ev == MGOS_XYMODEM_SESSION_PROGRESS) {
+		res->progress_calls++;
+		if(res->cancel_session != NULL && stats->packets_sent == res->cancel_at_packet) {
+			mgos_xymodem_session_cancel(res->cancel_session);
+		}
+		return;
+	}
+
+	res->done_calls++;
+}
+
+// Deterministic pseudo-random test data
+void test_fill(uint8_t *buf, size_t len, unsigned int seed)
+{
+	size_t i;
+
+	for(i = 0; i < len; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = (uint8_t)(seed >> 16);
+	}
+}
@@ -0,0 +1,35 @@
+/*
+ * Shared helpers for the host tests.
+ */
+
+#ifndef MGOS_XYMODEM_TEST_COMMON_H
+#define MGOS_XYMODEM_TEST_COMMON_H
+
+#include "mgos_xymodem.h"
+#include "host.h"
+#include "ref_receiver.h"
+
+extern int test_failures;
+
+#define CHECK(cond) \
+	do { \
+		if(!(cond)) { \
+			fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+			test_failures++; \
+		} \
+	} while(0)
+
+// Session callback recorder
+typedef struct test_result_t {
+	int progress_calls;
+	int done_calls;
+	int last_event;
+	mgos_xymodem_stats stats;
+	mgos_xymodem_session *cancel_session;
+	int cancel_at_packet;
+} test_result;
+
+void test_session_cb(int, mgos_xymodem_stats *, void *);
+void test_fill(uint8_t *, size_t, unsigned int);
+
+#endif
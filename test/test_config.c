@@ -0,0 +1,80 @@
+/*
+ * Checks the reduced build configurations (MGOS_XYMODEM_ENABLE_*). Built once
+ * as YMODEM-1K-CRC only and once as XMODEM-128-checksum only.
+ */
+
+#include "test_common.h"
+
+static test_result res;
+static ref_rx rx;
+
+static void start_transfer(int protocol, const uint8_t *prefix, size_t prefix_len, bool crc)
+{
+	static uint8_t data[2000];
+	mgos_xymodem_session *session;
+
+	test_fill(data, sizeof(data), 11);
+
+	memset(&res, 0x0, sizeof(res));
+	host_reset();
+	rx.nak_block = -1;
+	rx.greeting = prefix;
+	rx.greeting_len = prefix_len;
+	ref_rx_start(&rx, protocol == MGOS_XYMODEM_PROTOCOL_YMODEM, crc);
+
+	session = mgos_xymodem_session_create(0, protocol, false, test_session_cb, &res);
+	CHECK(session != NULL);
+	CHECK(mgos_xymodem_session_add_data(session, (char *)data, sizeof(data), "cfg.bin"));
+	mgos_xymodem_session_start(session);
+	host_run();
+
+	if(res.last_event == MGOS_XYMODEM_SESSION_COMPLETE) {
+		CHECK(rx.file_count == 1 && rx.files[0].len >= sizeof(data) && memcmp(rx.files[0].data, data, sizeof(data)) == 0);
+	}
+
+	ref_rx_free(&rx);
+}
+
+int main(void)
+{
+	mgos_xymodem_init();
+
+#if MGOS_XYMODEM_ENABLE_YMODEM && !MGOS_XYMODEM_ENABLE_CHECKSUM
+	{
+		const uint8_t nak[] = { MGOS_XYMODEM_NAK, MGOS_XYMODEM_CRC16 };
+		const uint8_t crc[] = { MGOS_XYMODEM_CRC16 };
+
+		CHECK(mgos_xymodem_session_create(0, MGOS_XYMODEM_PROTOCOL_XMODEM, false, NULL, NULL) == NULL);
+		CHECK(!mgos_xymodem_transmit(0, (FILE *)NULL));
+
+		// A NAK asks for checksum, which receivers never upgrade from; fail at once
+		start_transfer(MGOS_XYMODEM_PROTOCOL_YMODEM, nak, sizeof(nak), true);
+		CHECK(res.done_calls == 1 && res.last_event == MGOS_XYMODEM_SESSION_FAILED);
+		CHECK(rx.frames == 0);
+
+		start_transfer(MGOS_XYMODEM_PROTOCOL_YMODEM, crc, sizeof(crc), true);
+		CHECK(res.done_calls == 1 && res.last_event == MGOS_XYMODEM_SESSION_COMPLETE);
+	}
+#endif
+
+#if MGOS_XYMODEM_ENABLE_XMODEM && !MGOS_XYMODEM_ENABLE_CRC16
+	{
+		const uint8_t fallback[] = { MGOS_XYMODEM_CRC16, MGOS_XYMODEM_CRC16, MGOS_XYMODEM_NAK };
+
+		CHECK(mgos_xymodem_session_create(0, MGOS_XYMODEM_PROTOCOL_YMODEM, false, NULL, NULL) == NULL);
+		CHECK(!mgos_xymodem_transmit(0, (FILE *)NULL, "cfg.bin"));
+
+		// The receiver falls back from CRC16 to checksum after a few tries
+		start_transfer(MGOS_XYMODEM_PROTOCOL_XMODEM, fallback, sizeof(fallback), false);
+		CHECK(res.done_calls == 1 && res.last_event == MGOS_XYMODEM_SESSION_COMPLETE);
+	}
+#endif
+
+	if(test_failures > 0) {
+		fprintf(stderr, "test_config: %d check(s) failed\n", test_failures);
+		return 1;
+	}
+
+	printf("test_config: OK\n");
+	return 0;
+}
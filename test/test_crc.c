@@ -0,0 +1,44 @@
+/*
+ * Checks the inlined mgos_xymodem_calc_crc16() against the CRC-16/XMODEM check
+ * value and against the generic mgos_xymodem_calc_crc() it replaced.
+ */
+
+#include "test_common.h"
+
+#define TEST_CRC_BUFFERS	64
+
+static void check_generic(size_t len, unsigned int seed)
+{
+	uint8_t data[1024];
+	unsigned int generic;
+
+	test_fill(data, len, seed);
+	generic = mgos_xymodem_calc_crc(data, 0, len, false, false, 0x1021, 0x0000, 0x0000, 0x8000, 0xffff);
+	CHECK(mgos_xymodem_calc_crc16(data, len) == generic);
+}
+
+int main(void)
+{
+	const char *check = "123456789";
+	unsigned int seed;
+
+	CHECK(mgos_xymodem_calc_crc16((const uint8_t *)check, strlen(check)) == 0x31C3);
+	CHECK(mgos_xymodem_calc_crc((uint8_t *)check, 0, strlen(check), false, false, 0x1021, 0x0000, 0x0000, 0x8000, 0xffff) == 0x31C3);
+
+	// The reference receiver's own implementations, used to validate frames
+	CHECK(ref_crc16((const uint8_t *)check, strlen(check)) == 0x31C3);
+	CHECK(ref_checksum((const uint8_t *)check, strlen(check)) == 0xDD);
+
+	for(seed = 1; seed <= TEST_CRC_BUFFERS; seed++) {
+		check_generic(128, seed);
+		check_generic(1024, seed);
+	}
+
+	if(test_failures > 0) {
+		fprintf(stderr, "test_crc: %d check(s) failed\n", test_failures);
+		return 1;
+	}
+
+	printf("test_crc: OK\n");
+	return 0;
+}
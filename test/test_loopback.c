@@ -0,0 +1,302 @@
+/*
+ * Runs complete transfers between the sender and the reference receiver
+ * over the fake UART and checks the received data and the session stats.
+ */
+
+#include "test_common.h"
+
+static test_result res;
+static ref_rx rx;
+
+static mgos_xymodem_session *start_session(int protocol, bool progress)
+{
+	memset(&res, 0x0, sizeof(res));
+	host_reset();
+	return mgos_xymodem_session_create(0, protocol, progress, test_session_cb, &res);
+}
+
+static void test_ymodem_batch(bool crc)
+{
+	mgos_xymodem_session *session;
+	uint8_t file_data[2048], buf_data[3000];
+	FILE *fp;
+
+	test_fill(file_data, sizeof(file_data), 1);
+	test_fill(buf_data, sizeof(buf_data), 2);
+
+	fp = tmpfile();
+	fwrite(file_data, 1, sizeof(file_data), fp);
+
+	session = start_session(MGOS_XYMODEM_PROTOCOL_YMODEM, true);
+	rx.nak_block = 2;
+	ref_rx_start(&rx, true, crc);
+
+	CHECK(mgos_xymodem_session_add_file(session, fp, "a.bin"));
+	CHECK(mgos_xymodem_session_add_data(session, (char *)buf_data, sizeof(buf_data), "b.txt"));
+	mgos_xymodem_session_start(session);
+	host_run();
+
+	CHECK(rx.done && !rx.error && !rx.cancelled);
+	CHECK(rx.file_count == 2);
+	CHECK(strcmp(rx.files[0].name, "a.bin") == 0);
+	CHECK(rx.files[0].len == sizeof(file_data) && memcmp(rx.files[0].data, file_data, sizeof(file_data)) == 0);
+	CHECK(strcmp(rx.files[1].name, "b.txt") == 0);
+	CHECK(rx.files[1].len == sizeof(buf_data) && memcmp(rx.files[1].data, buf_data, sizeof(buf_data)) == 0);
+	CHECK(rx.duplicates == 0);
+
+	CHECK(res.done_calls == 1 && res.last_event == MGOS_XYMODEM_SESSION_COMPLETE);
+	CHECK(res.stats.bytes_sent == sizeof(file_data) + sizeof(buf_data));
+	CHECK(res.stats.total_bytes == sizeof(file_data) + sizeof(buf_data));
+	CHECK(res.stats.files_sent == 2 && res.stats.total_files == 2);
+	// The single injected NAK is the only retry; a stray 'C' would add more
+	CHECK(res.stats.retries == 1);
+	CHECK(res.progress_calls == 5);
+
+	ref_rx_free(&rx);
+	fclose(fp);
+}
+
+static void test_ymodem_block_wrap(void)
+{
+	mgos_xymodem_session *session;
+	static uint8_t data[300 * 1024 + 17];
+
+	test_fill(data, sizeof(data), 3);
+
+	session = start_session(MGOS_XYMODEM_PROTOCOL_YMODEM, false);
+	rx.nak_block = -1;
+	ref_rx_start(&rx, true, true);
+
+	CHECK(mgos_xymodem_session_add_data(session, (char *)data, sizeof(data), "big.bin"));
+	mgos_xymodem_session_start(session);
+	host_run();
+
+	CHECK(rx.done && !rx.error);
+	CHECK(rx.file_count == 1 && rx.files[0].len == sizeof(data) && memcmp(rx.files[0].data, data, sizeof(data)) == 0);
+	CHECK(res.done_calls == 1 && res.last_event == MGOS_XYMODEM_SESSION_COMPLETE);
+	CHECK(res.stats.retries == 0);
+
+	ref_rx_free(&rx);
+}
+
+static void test_xmodem(bool crc)
+{
+	mgos_xymodem_session *session;
+	uint8_t data[300];
+	size_t i;
+
+	test_fill(data, sizeof(data), 4);
+
+	session = start_session(MGOS_XYMODEM_PROTOCOL_XMODEM, false);
+	rx.nak_block = 1;
+	ref_rx_start(&rx, false, crc);
+
+	CHECK(mgos_xymodem_session_add_data(session, (char *)data, sizeof(data), NULL));
+	mgos_xymodem_session_start(session);
+	host_run();
+
+	CHECK(rx.done && !rx.error);
+	CHECK(rx.file_count == 1 && rx.files[0].len >= sizeof(data));
+	CHECK(memcmp(rx.files[0].data, data, sizeof(data)) == 0);
+	for(i = sizeof(data); i < rx.files[0].len; i++) {
+		CHECK(rx.files[0].data[i] == MGOS_XYMODEM_CPMEOF);
+	}
+	CHECK(res.done_calls == 1 && res.last_event == MGOS_XYMODEM_SESSION_COMPLETE);
+	CHECK(res.stats.bytes_sent == sizeof(data) && res.stats.retries == 1);
+
+	ref_rx_free(&rx);
+}
+
+static void test_legacy_transmit(void)
+{
+	uint8_t data[1500];
+	FILE *fp;
+
+	test_fill(data, sizeof(data), 5);
+	fp = tmpfile();
+	fwrite(data, 1, sizeof(data), fp);
+
+	host_reset();
+	rx.nak_block = -1;
+	ref_rx_start(&rx, true, true);
+
+	CHECK(mgos_xymodem_transmit(0, fp, (char *)"legacy.bin"));
+	host_run();
+
+	CHECK(rx.done && !rx.error);
+	CHECK(rx.file_count == 1 && strcmp(rx.files[0].name, "legacy.bin") == 0);
+	CHECK(rx.files[0].len == sizeof(data) && memcmp(rx.files[0].data, data, sizeof(data)) == 0);
+
+	ref_rx_free(&rx);
+	fclose(fp);
+}
+
+static void test_cancel(void)
+{
+	mgos_xymodem_session *session;
+	uint8_t data[5000];
+
+	test_fill(data, sizeof(data), 6);
+
+	session = start_session(MGOS_XYMODEM_PROTOCOL_YMODEM, true);
+	res.cancel_session = session;
+	res.cancel_at_packet = 2;
+	rx.nak_block = -1;
+	ref_rx_start(&rx, true, true);
+
+	CHECK(mgos_xymodem_session_add_data(session, (char *)data, sizeof(data), "c.bin"));
+	mgos_xymodem_session_start(session);
+	host_run();
+
+	CHECK(rx.cancelled);
+	CHECK(res.done_calls == 1 && res.last_event == MGOS_XYMODEM_SESSION_FAILED);
+	CHECK(res.stats.bytes_sent == 1024);
+
+	ref_rx_free(&rx);
+}
+
+static void test_after_header(void)
+{
+	mgos_xymodem_session *session;
+	const uint8_t cancel[] = { MGOS_XYMODEM_CAN, MGOS_XYMODEM_CAN };
+	const uint8_t noise[] = { 'X', MGOS_XYMODEM_CRC16 };
+	uint8_t data[1500];
+
+	test_fill(data, sizeof(data), 14);
+
+	// Cancelled by the receiver instead of asking for the first data block
+	session = start_session(MGOS_XYMODEM_PROTOCOL_YMODEM, false);
+	rx.nak_block = -1;
+	rx.after_header = cancel;
+	rx.after_header_len = sizeof(cancel);
+	ref_rx_start(&rx, true, true);
+
+	CHECK(mgos_xymodem_session_add_data(session, (char *)data, sizeof(data), "h.bin"));
+	mgos_xymodem_session_start(session);
+	host_run();
+
+	CHECK(res.done_calls == 1 && res.last_event == MGOS_XYMODEM_SESSION_FAILED);
+	CHECK(rx.frames == 1);
+	CHECK(res.stats.bytes_sent == 0);
+	ref_rx_free(&rx);
+
+	// A stray byte before the 'C' is skipped and the 'C' still consumed
+	session = start_session(MGOS_XYMODEM_PROTOCOL_YMODEM, false);
+	rx.after_header = noise;
+	rx.after_header_len = sizeof(noise);
+	ref_rx_start(&rx, true, true);
+
+	CHECK(mgos_xymodem_session_add_data(session, (char *)data, sizeof(data), "h.bin"));
+	mgos_xymodem_session_start(session);
+	host_run();
+
+	CHECK(res.done_calls == 1 && res.last_event == MGOS_XYMODEM_SESSION_COMPLETE);
+	CHECK(res.stats.retries == 0);
+	CHECK(rx.file_count == 1 && rx.files[0].len == sizeof(data) && memcmp(rx.files[0].data, data, sizeof(data)) == 0);
+	ref_rx_free(&rx);
+
+	rx.after_header = NULL;
+	rx.after_header_len = 0;
+}
+
+static void test_start_rules(void)
+{
+	mgos_xymodem_session *session, *other;
+	const uint8_t garbage[] = { 'X' };
+	uint8_t data[500];
+
+	test_fill(data, sizeof(data), 12);
+
+	session = start_session(MGOS_XYMODEM_PROTOCOL_YMODEM, false);
+	rx.nak_block = -1;
+	rx.greeting = garbage;
+	rx.greeting_len = sizeof(garbage);
+	ref_rx_start(&rx, true, true);
+	rx.greeting = NULL;
+
+	// Nothing to send: refused, and the session still belongs to the caller
+	CHECK(!mgos_xymodem_session_start(session));
+	CHECK(mgos_xymodem_session_add_data(session, (char *)data, sizeof(data), "rules.bin"));
+
+	// start() returns before the handshake; its failure comes through the callback
+	CHECK(mgos_xymodem_session_start(session));
+	CHECK(res.done_calls == 0 && rx.frames == 0);
+	CHECK(!mgos_xymodem_session_start(session));
+	CHECK(!mgos_xymodem_session_add_data(session, (char *)data, sizeof(data), "late.bin"));
+
+	// What a JS session object passes once the C session is gone
+	CHECK(!mgos_xymodem_session_add_data(NULL, (char *)data, sizeof(data), "null.bin"));
+	CHECK(!mgos_xymodem_session_add_file(NULL, NULL, (char *)"null.bin"));
+	CHECK(!mgos_xymodem_session_start(NULL));
+	mgos_xymodem_session_cancel(NULL);
+	mgos_xymodem_session_free(NULL);
+
+	other = mgos_xymodem_session_create(0, MGOS_XYMODEM_PROTOCOL_YMODEM, false, NULL, NULL);
+	CHECK(mgos_xymodem_session_add_data(other, (char *)data, sizeof(data), "other.bin"));
+	CHECK(!mgos_xymodem_session_start(other));
+	CHECK(!mgos_xymodem_transmit(0, NULL, (char *)"other.bin"));
+
+	host_run();
+
+	CHECK(res.done_calls == 1 && res.last_event == MGOS_XYMODEM_SESSION_FAILED);
+	CHECK(mgos_xymodem_config.active_session == NULL);
+
+	// Once the first transfer is over the second one can run
+	memset(&res, 0x0, sizeof(res));
+	ref_rx_free(&rx);
+	ref_rx_start(&rx, true, true);
+	mgos_xymodem_session_free(other);
+
+	other = mgos_xymodem_session_create(0, MGOS_XYMODEM_PROTOCOL_YMODEM, false, test_session_cb, &res);
+	CHECK(mgos_xymodem_session_add_data(other, (char *)data, sizeof(data), "other.bin"));
+	CHECK(mgos_xymodem_session_start(other));
+	host_run();
+
+	CHECK(res.done_calls == 1 && res.last_event == MGOS_XYMODEM_SESSION_COMPLETE);
+	CHECK(rx.file_count == 1 && rx.files[0].len == sizeof(data));
+
+	ref_rx_free(&rx);
+}
+
+static void test_header_limit(void)
+{
+	mgos_xymodem_session *session;
+	char name[1100];
+	uint8_t data[500];
+
+	test_fill(data, sizeof(data), 13);
+	session = mgos_xymodem_session_create(0, MGOS_XYMODEM_PROTOCOL_YMODEM, false, NULL, NULL);
+
+	// name + NUL + "500" + NUL has to fit in a 1K header block
+	memset(name, 'n', sizeof(name));
+	name[1020] = '\0';
+	CHECK(!mgos_xymodem_session_add_data(session, (char *)data, sizeof(data), name));
+	name[1019] = '\0';
+	CHECK(mgos_xymodem_session_add_data(session, (char *)data, sizeof(data), name));
+
+	mgos_xymodem_session_free(session);
+}
+
+int main(void)
+{
+	mgos_xymodem_init();
+
+	test_ymodem_batch(true);
+	test_ymodem_batch(false);
+	test_ymodem_block_wrap();
+	test_xmodem(true);
+	test_xmodem(false);
+	test_legacy_transmit();
+	test_cancel();
+	test_after_header();
+	test_start_rules();
+	test_header_limit();
+
+	if(test_failures > 0) {
+		fprintf(stderr, "test_loopback: %d check(s) failed\n", test_failures);
+		return 1;
+	}
+
+	printf("test_loopback: OK\n");
+	return 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * Conformance run against a reference receiver (lrzsz's rz) over a local PTY.
+ * Sends a YModem batch and an XModem file through the real library code and
+ * compares what rz wrote to disk. Exits with 77 (skipped) when neither rz nor
+ * lrz is installed; XYMODEM_RZ selects a different receiver binary.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "test_common.h"
+
+#define TEST_SKIP	77
+
+static char *find_rz(void)
+{
+	static char path[1024];
+	const char *candidates[] = { "rz", "lrz" };
+	char *env_path, *dir, *save = NULL;
+	size_t i;
+
+	if(getenv("XYMODEM_RZ") != NULL) {
+		return getenv("XYMODEM_RZ");
+	}
+
+	for(i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+		env_path = strdup(getenv("PATH") ? getenv("PATH") : "/usr/bin:/bin");
+		for(dir = strtok_r(env_path, ":", &save); dir != NULL; dir = strtok_r(NULL, ":", &save)) {
+			snprintf(path, sizeof(path), "%s/%s", dir, candidates[i]);
+			if(access(path, X_OK) == 0) {
+				free(env_path);
+				return path;
+			}
+		}
+		free(env_path);
+	}
+
+	return NULL;
+}
+
+// Starts the receiver with its stdin/stdout on a raw PTY, returns the master
+static int spawn_receiver(const char *rz, const char *dir, char *const argv[], pid_t *pid)
+{
+	struct termios tio;
+	int master, slave, devnull;
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if(master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+		perror("posix_openpt");
+		return -1;
+	}
+
+	slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+	if(slave < 0) {
+		perror("open pty slave");
+		return -1;
+	}
+
+	tcgetattr(slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+
+	*pid = fork();
+
+	if(*pid == 0) {
+		setsid();
+		if(chdir(dir) < 0) _exit(127);
+		dup2(slave, STDIN_FILENO);
+		dup2(slave, STDOUT_FILENO);
+		devnull = open("/dev/null", O_WRONLY);
+		if(devnull >= 0) dup2(devnull, STDERR_FILENO);
+		close(master);
+		close(slave);
+		execv(rz, argv);
+		_exit(127);
+	}
+
+	close(slave);
+	return master;
+}
+
+static bool read_file(const char *dir, const char *name, uint8_t **data, size_t *len)
+{
+	char path[1024];
+	FILE *fp;
+	long size;
+
+	*data = NULL;
+	*len = 0;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fp = fopen(path, "rb");
+	if(fp == NULL) {
+		return false;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	if(size >= 0) {
+		*data = malloc(size > 0 ? size : 1);
+	}
+
+	if(*data != NULL) {
+		*len = fread(*data, 1, size, fp);
+	}
+
+	fclose(fp);
+	unlink(path);
+
+	return *data != NULL;
+}
+
+// Compares a file rz wrote with what was sent; XModem files may carry CPMEOF padding
+static void check_received(const char *dir, const char *name, const uint8_t *sent, size_t sent_len, bool padded)
+{
+	uint8_t *got = NULL;
+	size_t len, i;
+
+	if(!read_file(dir, name, &got, &len)) {
+		fprintf(stderr, "test_pty: could not read %s from the receiver\n", name);
+		test_failures++;
+		return;
+	}
+
+	CHECK(padded ? len >= sent_len : len == sent_len);
+	CHECK(len >= sent_len && memcmp(got, sent, sent_len) == 0);
+	for(i = sent_len; i < len; i++) {
+		CHECK(got[i] == MGOS_XYMODEM_CPMEOF);
+	}
+
+	free(got);
+}
+
+static void run_transfer(const char *rz, const char *dir, char *const argv[], mgos_xymodem_session *session, test_result *res)
+{
+	pid_t pid;
+	int master, status;
+
+	master = spawn_receiver(rz, dir, argv, &pid);
+	CHECK(master >= 0);
+	if(master < 0) {
+		// Never started, so still ours
+		mgos_xymodem_session_free(session);
+		return;
+	}
+
+	host_reset();
+	host_uart_attach_fd(master);
+
+	mgos_xymodem_session_start(session);
+	host_run();
+
+	CHECK(res->done_calls == 1 && res->last_event == MGOS_XYMODEM_SESSION_COMPLETE);
+
+	// rz exits on its own after a successful transfer; don't wait forever otherwise
+	if(res->last_event != MGOS_XYMODEM_SESSION_COMPLETE) {
+		kill(pid, SIGTERM);
+	}
+	waitpid(pid, &status, 0);
+	close(master);
+
+	CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+int main(void)
+{
+	static uint8_t data_a[5000], data_b[700], data_x[300];
+	char dir[] = "/tmp/xymodem_pty_XXXXXX";
+	char *rz = find_rz();
+	mgos_xymodem_session *session;
+	test_result res;
+
+	if(rz == NULL) {
+		printf("test_pty: SKIP (no rz/lrz in PATH, set XYMODEM_RZ)\n");
+		return TEST_SKIP;
+	}
+
+	if(mkdtemp(dir) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+
+	mgos_xymodem_init();
+
+	// Real time, polling the PTY every 20ms instead of every second
+	host_sleep_divisor = 50;
+
+	test_fill(data_a, sizeof(data_a), 8);
+	test_fill(data_b, sizeof(data_b), 9);
+	test_fill(data_x, sizeof(data_x), 10);
+
+	// YModem batch
+	{
+		char *argv[] = { rz, (char *)"--ymodem", NULL };
+
+		memset(&res, 0x0, sizeof(res));
+		session = mgos_xymodem_session_create(0, MGOS_XYMODEM_PROTOCOL_YMODEM, false, test_session_cb, &res);
+		CHECK(mgos_xymodem_session_add_data(session, (char *)data_a, sizeof(data_a), "a.bin"));
+		CHECK(mgos_xymodem_session_add_data(session, (char *)data_b, sizeof(data_b), "b.bin"));
+		run_transfer(rz, dir, argv, session, &res);
+
+		check_received(dir, "a.bin", data_a, sizeof(data_a), false);
+		check_received(dir, "b.bin", data_b, sizeof(data_b), false);
+	}
+
+	// XModem: no length on the wire, so rz keeps the padding of the last block
+	{
+		char *argv[] = { rz, (char *)"--xmodem", (char *)"x.bin", NULL };
+
+		memset(&res, 0x0, sizeof(res));
+		session = mgos_xymodem_session_create(0, MGOS_XYMODEM_PROTOCOL_XMODEM, false, test_session_cb, &res);
+		CHECK(mgos_xymodem_session_add_data(session, (char *)data_x, sizeof(data_x), NULL));
+		run_transfer(rz, dir, argv, session, &res);
+
+		check_received(dir, "x.bin", data_x, sizeof(data_x), true);
+	}
+
+	rmdir(dir);
+
+	if(test_failures > 0) {
+		fprintf(stderr, "test_pty: %d check(s) failed\n", test_failures);
+		return 1;
+	}
+
+	printf("test_pty: OK\n");
+	return 0;
+}
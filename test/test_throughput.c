@@ -0,0 +1,90 @@
+/*
+ * Throughput regression check: times a large in-memory YModem transfer to the
+ * reference receiver and the CRC16 routine, and fails when either drops below
+ * its threshold.
+ *
+ * The transfer time is the CPU time of the send path plus the time the library
+ * spends in mgos_msleep(), which the host advances on a virtual clock. The
+ * polling sleep in mgos_xymodem_read_byte() dominates it, as it does on the
+ * device, so a change that adds sleeps or round trips shows up here.
+ *
+ * Thresholds are in KiB/s and can be overridden with XYMODEM_MIN_SEND_KBPS
+ * and XYMODEM_MIN_CRC_KBPS.
+ */
+
+#include <time.h>
+
+#include "test_common.h"
+
+#define TEST_SEND_BYTES		(1024 * 1024)
+#define TEST_CRC_ROUNDS		8192
+
+#define DEFAULT_MIN_SEND_KBPS	0.9
+#define DEFAULT_MIN_CRC_KBPS	100000
+
+static double env_threshold(const char *name, double def)
+{
+	const char *value = getenv(name);
+	return (value != NULL) ? atof(value) : def;
+}
+
+int main(void)
+{
+	static uint8_t data[TEST_SEND_BYTES];
+	mgos_xymodem_session *session;
+	test_result res;
+	ref_rx rx;
+	clock_t cpu_start;
+	double sleep_start, start, elapsed, send_kbps, crc_kbps, min_send, min_crc;
+	volatile uint16_t crc = 0;
+	int i;
+
+	mgos_xymodem_init();
+	test_fill(data, sizeof(data), 7);
+
+	memset(&res, 0x0, sizeof(res));
+	memset(&rx, 0x0, sizeof(rx));
+	host_reset();
+	rx.nak_block = -1;
+	ref_rx_start(&rx, true, true);
+
+	session = mgos_xymodem_session_create(0, MGOS_XYMODEM_PROTOCOL_YMODEM, false, test_session_cb, &res);
+	mgos_xymodem_session_add_data(session, (char *)data, sizeof(data), "throughput.bin");
+
+	cpu_start = clock();
+	sleep_start = host_sleep_time();
+	mgos_xymodem_session_start(session);
+	host_run();
+	elapsed = (double)(clock() - cpu_start) / CLOCKS_PER_SEC + (host_sleep_time() - sleep_start);
+
+	CHECK(res.last_event == MGOS_XYMODEM_SESSION_COMPLETE);
+	CHECK(rx.file_count == 1 && rx.files[0].len == sizeof(data));
+	ref_rx_free(&rx);
+
+	send_kbps = (sizeof(data) / 1024.0) / elapsed;
+
+	start = mgos_uptime();
+	for(i = 0; i < TEST_CRC_ROUNDS; i++) {
+		crc ^= mgos_xymodem_calc_crc16(data + (i % 64), 1024);
+	}
+	elapsed = mgos_uptime() - start;
+
+	crc_kbps = TEST_CRC_ROUNDS / elapsed;
+
+	min_send = env_threshold("XYMODEM_MIN_SEND_KBPS", DEFAULT_MIN_SEND_KBPS);
+	min_crc = env_threshold("XYMODEM_MIN_CRC_KBPS", DEFAULT_MIN_CRC_KBPS);
+
+	printf("test_throughput: send path %.2f KiB/s (min %.2f), CRC16 %.0f KiB/s (min %.0f)\n",
+		send_kbps, min_send, crc_kbps, min_crc);
+
+	CHECK(send_kbps >= min_send);
+	CHECK(crc_kbps >= min_crc);
+
+	if(test_failures > 0) {
+		fprintf(stderr, "test_throughput: %d check(s) failed\n", test_failures);
+		return 1;
+	}
+
+	printf("test_throughput: OK\n");
+	return 0;
+}